@@ -15,15 +15,68 @@
 //    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <QDebug>
-#include <QQueue>
+#include <QtConcurrent>
 #include "utils.h"
+#include "kernels.h"
 #include "analogsignal.h"
 
+namespace {
+
+// Part of the samples for the parallel calculation of the statistics
+struct StatisticsChunk
+{
+	static constexpr qsizetype Size = 1 << 20;
+
+	qsizetype begin;
+	qsizetype end;
+	bool found;
+	double min;
+	double max;
+	double sum;
+	double squares;
+};
+
+}
+
 AnalogSignal::AnalogSignal(QObject *parent)
-	: QObject(parent), mName(""), mUnit(""), mFactor(1.0), mScale(1.0), mSmooth(1), mSelected(false), mTime(nullptr)
+	: QObject(parent), mName(""), mUnit(""), mFactor(1.0), mScale(1.0), mSmooth(1), mSelected(false), mTime(nullptr), mMinY(qInf()), mMaxY(-qInf()), mMean(qQNaN()), mRms(qQNaN()), mSmoothCache(1), mPyramidSmooth(1), mRevision(0)
 {
 }
 
+// Copy of the signal, the samples and the file they are loaded from are shared
+AnalogSignal *AnalogSignal::clone(const TimeAxis *time, QObject *parent) const
+{
+	auto *signal = new AnalogSignal(parent);
+
+	signal->mName = mName;
+	signal->mUnit = mUnit;
+	signal->mColor = mColor;
+	signal->mFactor = mFactor;
+	signal->mScale = mScale;
+	signal->mSmooth = mSmooth;
+	signal->mSelected = mSelected;
+	signal->mData = mData;
+	signal->mTime = time;
+	signal->mSource = mSource;
+	signal->mBlocks = mBlocks;
+	signal->mEncoding = mEncoding;
+	signal->mMinY = mMinY;
+	signal->mMaxY = mMaxY;
+	signal->mMean = mMean;
+	signal->mRms = mRms;
+	signal->mSums = mSums;
+	signal->mSmoothed = mSmoothed;
+	signal->mSmoothCache = mSmoothCache;
+	signal->mPyramid = mPyramid;
+	signal->mPyramidSmooth = mPyramidSmooth;
+	signal->mPyramidSource = mPyramidSource;
+	signal->mMinimumBlocks = mMinimumBlocks;
+	signal->mMaximumBlocks = mMaximumBlocks;
+	signal->mRevision = mRevision;
+
+	return signal;
+}
+
 QString AnalogSignal::name(const bool legend) const
 {
 	if (legend) {
@@ -37,6 +90,98 @@ QString AnalogSignal::name(const bool legend) const
 	}
 }
 
+qsizetype AnalogSignal::dataCount() const
+{
+	return isLoaded() ? mData.count() : static_cast<qsizetype>(samplesCount(mBlocks));
+}
+
+void AnalogSignal::setSource(PlotFileReaderPtr source, const PlotBlockList blocks)
+{
+	mData.clear();
+	resetCaches();
+	mSource = source;
+	mBlocks = blocks;
+	mEncoding = SampleEncoding();
+}
+
+// Pyramid of the not smoothed samples stored in the plot file
+void AnalogSignal::setPyramidSource(PlotFileReaderPtr source, const PlotBlockList minimums, const PlotBlockList maximums)
+{
+	mPyramid.clear();
+	mPyramidSource = source;
+	mMinimumBlocks = minimums;
+	mMaximumBlocks = maximums;
+}
+
+bool AnalogSignal::load()
+{
+	if (isLoaded()) return true;
+
+	// Use uncompressed samples straight from the mapped file
+	const double *mapped = mSource->map(mBlocks);
+	if (mapped != nullptr) {
+		mData = Samples(mSource, mapped, static_cast<qsizetype>(samplesCount(mBlocks)));
+		mSource.clear();
+		mBlocks.clear();
+		return true;
+	}
+
+	QVector<double> data;
+	if (mSource->read(mBlocks, data, &mEncoding)) {
+		mData = Samples(data);
+		mSource.clear();
+		mBlocks.clear();
+		return true;
+	}
+
+	qDebug() << "Unable to load" << mName << "from" << mSource->fileName();
+	return false;
+}
+
+// Makes the signal independent from the file it is loaded or mapped from,
+// the pyramid is built again from the samples when it is needed
+bool AnalogSignal::detach()
+{
+	if (!load()) return false;
+	mData.vector();
+	mPyramid.detach();
+	mPyramidSource.clear();
+	return true;
+}
+
+// Files the samples and the pyramid are loaded, mapped or going to be read from
+QVector<PlotFileReaderPtr> AnalogSignal::sources() const
+{
+	QVector<PlotFileReaderPtr> result;
+	for (const auto &source : {mSource, mPyramidSource, mData.source(), mPyramid.minimums().source(), mPyramid.maximums().source()}) {
+		if (!source.isNull() && !result.contains(source)) result.append(source);
+	}
+	return result;
+}
+
+// Samples and the pyramid which are not loaded yet are read from the file they were saved to
+void AnalogSignal::moveSource(PlotFileReaderPtr source, const PlotBlockList blocks, const PlotBlockList minimums, const PlotBlockList maximums)
+{
+	if (!isLoaded()) {
+		mSource = source;
+		mBlocks = blocks;
+	}
+
+	// The pyramid which isn't saved is built again from the samples
+	if (!mPyramidSource.isNull()) {
+		mPyramidSource = minimums.isEmpty() ? PlotFileReaderPtr() : source;
+		mMinimumBlocks = minimums;
+		mMaximumBlocks = maximums;
+	}
+}
+
+// Samples which can't be restored exactly are kept as doubles
+void AnalogSignal::chooseEncoding()
+{
+	if (!load()) return;
+	mEncoding = ::chooseEncoding(mData.constData(), mData.count());
+}
+
 void AnalogSignal::clear()
 {
 	mName.clear();
@@ -48,47 +193,149 @@ void AnalogSignal::clear()
 
 void AnalogSignal::invert()
 {
-	for (qsizetype i = 0; i < mData.count(); i++) mData[i] *= -1.0;
+	load();
+	auto &data = mData.vector();
+	Kernels::negate(data.data(), data.count());
+	resetCaches();
+
+	// Inverted samples may not fit the encoding, it is chosen again when it is needed
+	mEncoding = SampleEncoding();
+
+	const double min = mMinY;
+	mMinY = -mMaxY;
+	mMaxY = -min;
+	mMean = -mMean;
 }
 
 void AnalogSignal::calculateLimits() {
+	// Statistics of the not loaded signal are read from the file
+	if (!isLoaded()) return;
+
+	// Chunks are processed in parallel and combined in order,
+	// so the sums don't depend on the count of threads
+	const double *data = mData.constData();
+	const qsizetype count = mData.count();
+	QVector<StatisticsChunk> chunks((count + StatisticsChunk::Size - 1) / StatisticsChunk::Size);
+	for (qsizetype i = 0; i < chunks.count(); i++) {
+		chunks[i].begin = i * StatisticsChunk::Size;
+		chunks[i].end = qMin(chunks[i].begin + StatisticsChunk::Size, count);
+	}
+
+	QtConcurrent::blockingMap(chunks, [data](StatisticsChunk &chunk) {
+		const qsizetype size = chunk.end - chunk.begin;
+		chunk.found = Kernels::limits(data + chunk.begin, size, chunk.min, chunk.max);
+		Kernels::moments(data + chunk.begin, size, chunk.sum, chunk.squares);
+	});
+
+	// NaN samples are skipped by the limits, the signal of NaN samples has infinite limits
+	double sum = 0.0;
+	double squares = 0.0;
 	mMinY = qInf();
 	mMaxY = -qInf();
+	for (const auto &chunk : qAsConst(chunks)) {
+		if (chunk.found) {
+			mMinY = qMin(mMinY, chunk.min);
+			mMaxY = qMax(mMaxY, chunk.max);
+		}
+		sum += chunk.sum;
+		squares += chunk.squares;
+	}
+
+	mMean = (count > 0) ? sum / count : qQNaN();
+	mRms = (count > 0) ? qSqrt(squares / count) : qQNaN();
+}
+
+// Samples are not scaled, the factor and the scale are applied by the graph.
+// Not smoothed signal returns its own samples without a copy.
+const Samples &AnalogSignal::smoothed() {
+	load();
+
+	if (mSmooth <= 1) return mData;
 
-	foreach (qreal val, mData) {
-		mMinY = qMin(mMinY, val);
-		mMaxY = qMax(mMaxY, val);
+	if ((mSmoothed.count() != mData.count()) || (mSmooth != mSmoothCache)) {
+		const auto &sums = this->sums();
+		const qsizetype count = mData.count();
+		const qsizetype window = static_cast<qsizetype>(qMin<quint64>(mSmooth, static_cast<quint64>(count)));
+
+		// Average of the window ending at every sample, the first samples have shorter windows
+		QVector<double> smoothed(count);
+		Kernels::movingAverage(sums.constData(), count, window, smoothed.data());
+		mSmoothed = Samples(smoothed);
+		mSmoothCache = mSmooth;
 	}
+
+	return mSmoothed;
 }
 
-QVector<double> &AnalogSignal::smoothed() {
-	double multiplier = mFactor * mScale;
+// Built on the first use and rebuilt when the smoothing is changed
+const Pyramid &AnalogSignal::pyramid() {
+	// Stored levels of the not smoothed samples are used without loading the samples
+	if (mSmooth <= 1) {
+		if (!mPyramidSource.isNull()) loadPyramid();
+		if ((mPyramidSmooth == 1) && (mPyramid.count() == dataCount())) return mPyramid;
+	}
+
+	const Samples &samples = smoothed();
+	if ((mPyramid.count() != samples.count()) || (mSmooth != mPyramidSmooth)) {
+		mPyramid.build(samples.constData(), samples.count());
+		mPyramidSmooth = mSmooth;
+	}
 
-	if ((mDataCache.count() != mData.count()) ||
-		(multiplier != mMutyplierCache) ||
-		(mSmooth != mSmoothCache)
-	){
-		mDataCache.clear();
-		mDataCache.reserve(mData.count());
+	return mPyramid;
+}
 
-		if (mSmooth > 1) {
-			qreal value = 0.0;
-			QQueue<qreal> buffer;
+// Uncompressed levels are used straight from the mapped file
+bool AnalogSignal::loadPyramid()
+{
+	auto source = mPyramidSource;
+	mPyramidSource.clear();
 
-			for (qsizetype i = 0; i < qMin(mData.count(), mTime->count()); i++) {
-				value += mData.at(i);
-				buffer.enqueue(mData.at(i));
-				if (buffer.count() > static_cast<int>(mSmooth)) value -= buffer.dequeue();
-				mDataCache.append(value / buffer.count());
-			}
-		} else {
-			mDataCache = mData;
+	auto read = [&source](const PlotBlockList &blocks, Samples &levels) {
+		const double *mapped = source->map(blocks);
+		if (mapped != nullptr) {
+			levels = Samples(source, mapped, static_cast<qsizetype>(samplesCount(blocks)));
+			return true;
 		}
 
-		multyply(mDataCache, multiplier);
+		QVector<double> data;
+		if (!source->read(blocks, data)) return false;
+		levels = Samples(data);
+		return true;
+	};
+
+	Samples minimums, maximums;
+	const bool ok = read(mMinimumBlocks, minimums) && read(mMaximumBlocks, maximums) && mPyramid.setLevels(dataCount(), minimums, maximums);
+	mMinimumBlocks.clear();
+	mMaximumBlocks.clear();
+
+	if (!ok) {
+		qDebug() << "Unable to load the pyramid of" << mName << "from" << source->fileName();
+		return false;
+	}
+
+	mPyramidSmooth = 1;
+	return true;
+}
+
+// Prefix sums are calculated once for any width of the moving average
+const QVector<double> &AnalogSignal::sums()
+{
+	if (mSums.count() != mData.count() + 1) {
+		mSums.resize(mData.count() + 1);
+		Kernels::prefixSums(mData.constData(), mData.count(), mSums.data());
 	}
 
-	return mDataCache;
+	return mSums;
+}
+
+// Cached data derived from the samples which are changed
+void AnalogSignal::resetCaches()
+{
+	mSums.clear();
+	mSmoothed.clear();
+	mPyramid.clear();
+	mPyramidSource.clear();
+	mRevision++;
 }
 
 QString AnalogSignal::toString()
@@ -96,7 +343,7 @@ QString AnalogSignal::toString()
 	return QString("Name:\t%1\nUnit:\t%2\nScale:\t%3\nSmoth:\t%4").arg(mName).arg(mUnit, mScale).arg(mSmooth);
 }
 
-bool AnalogSignal::saveToStream(QDataStream &stream) const
+bool AnalogSignal::saveMetadataToStream(QDataStream &stream) const
 {
 	stream
 		<< mName
@@ -107,29 +354,56 @@ bool AnalogSignal::saveToStream(QDataStream &stream) const
 		<< mSmooth
 		<< mMinY
 		<< mMaxY
-		<< mColor.name()
-		<< static_cast<quint64>(mData.count());
+		<< mColor.name();
+
+	return stream.status() == QDataStream::Ok;
+}
+
+bool AnalogSignal::loadMetadataFromStream(QDataStream &stream)
+{
+	QString colorname;
+
+	stream >> mName >> mUnit >> mSelected >> mFactor >> mScale >> mSmooth >> mMinY >> mMaxY >> colorname;
+
+	mColor = QColor(colorname);
 
-	for (qreal value : qAsConst(mData)) stream << value;
+	return stream.status() == QDataStream::Ok;
+}
+
+// Mean and RMS are stored, so they are known before the samples are loaded
+bool AnalogSignal::saveStatisticsToStream(QDataStream &stream) const
+{
+	stream << mMean << mRms;
+	return stream.status() == QDataStream::Ok;
+}
+
+bool AnalogSignal::loadStatisticsFromStream(QDataStream &stream)
+{
+	double mean, rms;
+	stream >> mean >> rms;
+	if (stream.status() != QDataStream::Ok) return false;
+
+	mMean = mean;
+	mRms = rms;
 	return true;
 }
 
 bool AnalogSignal::loadFromStream(QDataStream &stream)
 {
-	QString colorname;
 	qreal value;
 	quint64 count;
 
-	stream >> mName >> mUnit >> mSelected >> mFactor >> mScale >> mSmooth >> mMinY >> mMaxY >> colorname >> count;
-
-	mColor = QColor(colorname);
+	if (!loadMetadataFromStream(stream)) return false;
+	stream >> count;
 
-	mData.clear();
-	mData.reserve(count);
+	QVector<double> data;
+	data.reserve(count);
 	for (int i = count; i; i--) {
 		stream >> value;
-		mData.append(value);
+		data.append(value);
 	}
+	mData = Samples(data);
+	resetCaches();
 
-	return true;
+	return stream.status() == QDataStream::Ok;
 }
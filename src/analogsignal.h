@@ -20,6 +20,10 @@
 #include <QString>
 #include <QDataStream>
 #include <QColor>
+#include "plotfile.h"
+#include "samples.h"
+#include "pyramid.h"
+#include "timeaxis.h"
 
 class AnalogSignal : public QObject
 {
@@ -30,8 +34,12 @@ public:
 
 	QString name(const bool legend = false) const;
 	QString toString();
-	bool saveToStream(QDataStream &stream) const;
+	bool saveMetadataToStream(QDataStream &stream) const;
+	bool loadMetadataFromStream(QDataStream &stream);
+	bool saveStatisticsToStream(QDataStream &stream) const;
+	bool loadStatisticsFromStream(QDataStream &stream);
 	bool loadFromStream(QDataStream &stream);
+	AnalogSignal *clone(const TimeAxis *time, QObject *parent = nullptr) const;
 
 	auto unit()      const {return mUnit;}
 	auto color()     const {return mColor;}
@@ -40,12 +48,18 @@ public:
 	auto scale()     const {return mScale;}
 	auto minY()      const {return mMinY * mFactor;}
 	auto maxY()      const {return mMaxY * mFactor;}
-	auto *data()           {return &mData;}
-	auto dataCount() const {return mData.count();}
+	auto mean()      const {return mMean * mFactor;}
+	auto rms()       const {return mRms * qAbs(mFactor);}
+	const Samples &samples() {load(); return mData;}
+	auto *mutableData()    {load(); resetCaches(); return &mData.vector();}
+	qsizetype dataCount() const;
+	bool isLoaded()  const {return mSource.isNull();}
+	auto encoding()  const {return mEncoding;}
 	auto smooth()    const {return mSmooth;}
+	auto revision()  const {return mRevision;}
 
 public slots:
-	void setTime(QVector<double> *time)   { mTime = time;}
+	void setTime(const TimeAxis *time)    { mTime = time;}
 	void setName(const QString name)      { mName = name;}
 	void setUnit(const QString unit)      { mUnit = unit;}
 	void setFactor(const qreal factor)    { mFactor = factor;}
@@ -54,10 +68,19 @@ public slots:
 	void setColor(const QColor color)     { mColor = color;}
 	void setSmooth(const quint64 smooth)  { if (smooth > 0) mSmooth = smooth;}
 
+	void setSource(PlotFileReaderPtr source, const PlotBlockList blocks);
+	void setPyramidSource(PlotFileReaderPtr source, const PlotBlockList minimums, const PlotBlockList maximums);
+	bool load();
+	bool detach();
+	QVector<PlotFileReaderPtr> sources() const;
+	void moveSource(PlotFileReaderPtr source, const PlotBlockList blocks, const PlotBlockList minimums, const PlotBlockList maximums);
+	void chooseEncoding();
+
 	void clear();
 	void invert();
 	void calculateLimits();
-	QVector<double> &smoothed();
+	const Samples &smoothed();
+	const Pyramid &pyramid();
 
 private:
 	QString mName;
@@ -67,12 +90,27 @@ private:
 	double mScale;          // Scale for plot
 	quint64 mSmooth;
 	bool mSelected;
-	QVector<double> mData;
-	QVector<double> *mTime;
+	Samples mData;
+	const TimeAxis *mTime;
+	PlotFileReaderPtr mSource;  // The file to load samples from on demand
+	PlotBlockList mBlocks;
+	SampleEncoding mEncoding;   // Compact storage of the samples in the plot file
 	double mMinY;
 	double mMaxY;
+	double mMean;           // Statistics of the samples, NaN until they are calculated
+	double mRms;
+
+	QVector<double> mSums;      // Sums of the samples before every index
+	Samples mSmoothed;          // Moving average of the samples for mSmoothCache
+	quint64 mSmoothCache;
+	Pyramid mPyramid;           // Limits of the smoothed samples for mPyramidSmooth
+	quint64 mPyramidSmooth;
+	PlotFileReaderPtr mPyramidSource;   // The file to load the pyramid of the samples from
+	PlotBlockList mMinimumBlocks;
+	PlotBlockList mMaximumBlocks;
+	quint64 mRevision;          // Changed whenever the samples are changed
 
-	double mMutyplierCache;
-	unsigned int mSmoothCache;
-	QVector<double> mDataCache;
+	bool loadPyramid();
+	const QVector<double> &sums();
+	void resetCaches();
 };
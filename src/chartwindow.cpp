@@ -21,18 +21,50 @@
 #include <QPointer>
 #include <QFileInfo>
 #include <QMessageBox>
+#include <QSettings>
 #include <QMdiSubWindow>
+#include <QScreen>
+#include <QGuiApplication>
 #include <QPrintPreviewDialog>
+#include <QProgressDialog>
+#include <QCoreApplication>
+#include <QSharedPointer>
 #include "utils.h"
 #include "analogsignal.h"
+#include "signalgraph.h"
 #include "chartwindow.h"
 
 ChartWindow::ChartWindow(QWidget *parent, Qt::WindowFlags flags)
 	: QMdiSubWindow(parent, flags)
 	, mDataFile(nullptr)
+	, mLoadingFile(nullptr)
+	, mReplotsRequested(0)
+	, mReplotsPerformed(0)
 {
 	setAttribute(Qt::WA_DeleteOnClose, true);
 
+	// Replot requests made within one frame of the display are merged into one replot
+	auto *screen = QGuiApplication::primaryScreen();
+	auto rate = (screen != nullptr) ? screen->refreshRate() : 60.0;
+	mReplotTimer.setSingleShot(true);
+	mReplotTimer.setInterval(qMax(1, qRound(1000.0 / qMax(1.0, rate))));
+	connect(&mReplotTimer, &QTimer::timeout, this, [this]() {
+		mCustomPlot.replot();
+	});
+
+	// Replots made by the mouse interactions are counted too
+	connect(&mCustomPlot, &QCustomPlot::afterReplot, this, [this]() {
+		mReplotsPerformed++;
+	});
+
+	// Replot the partially loaded data no more often than 4 times per second
+	mPreviewTimer.setSingleShot(true);
+	mPreviewTimer.setInterval(250);
+	connect(&mPreviewTimer, &QTimer::timeout, this, [this]() {
+		mCustomPlot.rescaleAxes();
+		requestReplot();
+	});
+
 	mCustomPlot.setInteractions(QCP::iRangeDrag | QCP::iRangeZoom | QCP::iSelectPlottables | QCP::iMultiSelect);
 	mCustomPlot.xAxis->setLabel(tr("Time, s"));
 	mCustomPlot.yAxis->setLabel(tr("Voltage, V"));
@@ -49,50 +81,121 @@ void ChartWindow::closeEvent(QCloseEvent *event) {
 	}
 }
 
+void ChartWindow::setLoadingFile(DataFile *datafile) {
+	mLoadingFile = datafile;
+	mPreviewGraphs.clear();
+	mPreviewTimer.stop();
+	clearGraphs();
+
+	if (mLoadingFile != nullptr) {
+		mCustomPlot.legend->setVisible(true);
+		requestReplot();
+	}
+}
+
+// Legend names come with the data, as the units are set by the loading thread
+void ChartWindow::appendData(const QVector<double> &time, const QVector<QVector<double>> &data, const QStringList &names) {
+	if (mLoadingFile == nullptr) return;
+
+	// Add graphs for the selected signals with the first portion of data
+	if (mPreviewGraphs.count() != data.count()) {
+		mPreviewGraphs.clear();
+		mCustomPlot.clearGraphs();
+		for (qsizetype i = 0; (i < data.count()) && (i < mLoadingFile->analogSignalsCount()); i++) {
+			auto *signal = mLoadingFile->analogSignal(i);
+			QCPGraph *graph = nullptr;
+			if (signal->selected()) {
+				graph = mCustomPlot.addGraph();
+				graph->setPen(QPen(signal->color()));
+			}
+			mPreviewGraphs.append(graph);
+		}
+	}
+
+	// Smoothing is applied by refresh() when the file is loaded
+	for (qsizetype i = 0; i < mPreviewGraphs.count(); i++) {
+		auto *graph = mPreviewGraphs.at(i);
+		if (graph != nullptr) {
+			auto *signal = mLoadingFile->analogSignal(i);
+			if (i < names.count()) graph->setName(names.at(i));
+			QVector<double> values = data.at(i);
+			multyply(values, signal->factor() * signal->scale());
+			graph->addData(time, values, true);
+		}
+	}
+
+	if (!mPreviewTimer.isActive()) mPreviewTimer.start();
+}
+
+void ChartWindow::setPendingFile(const QString filename) {
+	mPendingFile = filename;
+	setWindowTitle(filename);
+}
+
 void ChartWindow::setDataFile(DataFile *datafile) {
+	setLoadingFile(nullptr);
 	if (mDataFile != nullptr) delete mDataFile;
 
 	mDataFile = datafile;
 
 	if (mDataFile != nullptr) {
+		mPendingFile.clear();
 		connect(mDataFile, &DataFile::modifiedChanged, this, &QMdiSubWindow::setWindowModified);
 		setWindowTitle(mDataFile->fileName() + "[*]");
 
-		connect(mDataFile, &DataFile::selectedChanged, this, [this](qsizetype channel, bool state) {
-			auto *graph = findGraph(mDataFile->analogSignal(channel)->name(true));
-			if (graph != nullptr) {
-				graph->setVisible(state);
-				mCustomPlot.replot();
-			} else {
-				refresh();
+		// Only the graph of the changed signal is touched
+		auto update = [this](qsizetype channel) {
+			if ((channel < 0) || (channel >= mDataFile->analogSignalsCount())) return;
+			auto count = mGraphs.count();
+			if (updateGraph(mDataFile->analogSignal(channel))) {
+				if (mGraphs.count() > count) sortLegend();
+				requestReplot();
 			}
-		});
+		};
+
+		connect(mDataFile, &DataFile::selectedChanged, this, update);
+		connect(mDataFile, &DataFile::signalChanged, this, update);
 
 		connect(mDataFile, &DataFile::colorChanged, this, [this](qsizetype channel, QColor color) {
-			auto *graph = findGraph(mDataFile->analogSignal(channel)->name(true));
+			if ((channel < 0) || (channel >= mDataFile->analogSignalsCount())) return;
+			auto *graph = mGraphs.value(mDataFile->analogSignal(channel), nullptr);
 			if (graph != nullptr) {
 				graph->setPen(QPen(color));
-				mCustomPlot.replot();
-			} else {
-				refresh();
+				requestReplot();
 			}
 		});
 	}
 }
 
 QString ChartWindow::userFriendlyCurrentFile() {
+	if (mDataFile == nullptr) return QFileInfo(windowTitle()).fileName();
 	return QFileInfo(mDataFile->fileName()).fileName();
 };
 
 bool ChartWindow::maybeSave() {
-	if (mDataFile->isModified()) {
+	// The file being saved in the background is finished first
+	if (mSaveThread) {
+		mSaveThread->wait();
+		QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+	}
+
+	if ((mDataFile != nullptr) && mDataFile->isModified()) {
 		switch (QMessageBox::warning(
 			this, tr("Recon Plotter"),
 			tr("'%1' has been modified.\nDo you want to save your changes?").arg(mDataFile->fileName()),
 			QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel
 		)) {
 		case QMessageBox::Save:
-			save();
+			// The window is closed, so the file is saved right away
+			if (mDataFile->isRenameNeeded()) {
+				save();
+				return false;
+			}
+			if (!mDataFile->save()) {
+				QMessageBox::warning(this, tr("Recon Plotter"), tr("Unable to save '%1'.").arg(mDataFile->fileName()));
+				return false;
+			}
+			addToRecent(mDataFile->fileName());
 			return true;
 		case QMessageBox::Cancel:
 			return false;
@@ -108,9 +211,7 @@ void ChartWindow::save() {
 		if (mDataFile->isRenameNeeded()) {
 			saveAs();
 		} else {
-			if (mDataFile->save()) {
-				addToRecent(mDataFile->fileName());
-			}
+			saveFile(mDataFile->fileName());
 		}
 	}
 }
@@ -126,33 +227,136 @@ void ChartWindow::saveAs() {
 
 		connect(dialog, &QFileDialog::accepted, this, [this, dialog]() {
 			auto files = dialog->selectedFiles();
-			if (!files.isEmpty())
-				if (mDataFile->saveAs(files.first()))
-					addToRecent(files.first());
+			mDataFile->setCompressed(QSettings().value("Compress", true).toBool());
+			mDataFile->setStorePyramids(QSettings().value("Pyramids", true).toBool());
+			if (!files.isEmpty()) saveFile(files.first());
 		});
 
 		dialog->open();
 	}
 }
 
+// The snapshot of the data file is saved in the worker thread, so the window stays responsive
+void ChartWindow::saveFile(const QString filename) {
+	if ((mDataFile == nullptr) || mSaveThread) return;
+
+	// Samples mapped from the file which is going to be replaced keep it open
+	if (!mDataFile->release(filename)) {
+		QMessageBox::warning(this, tr("Recon Plotter"), tr("Unable to save '%1'.").arg(filename));
+		return;
+	}
+
+	// Only the metadata is saved if the samples are not changed. Otherwise the signals
+	// which are not loaded yet are read from the saved file when the saving is finished.
+	auto *snapshot = mDataFile->snapshot();
+	auto changes = mDataFile->changes();
+	auto ok = QSharedPointer<bool>::create(false);
+	mSaveThread = QThread::create([snapshot, filename, ok]() {
+		*ok = snapshot->saveAs(filename);
+	});
+
+	// Progress is shown only if the saving takes a while
+	QPointer<QProgressDialog> dialog = new QProgressDialog(this);
+	dialog->setAttribute(Qt::WA_DeleteOnClose, true);
+	dialog->setLabelText(tr("Saving %1").arg(filename));
+	dialog->setMinimumDuration(500);
+	dialog->setAutoClose(false);
+	dialog->setAutoReset(false);
+
+	connect(dialog, &QProgressDialog::canceled, snapshot, &DataFile::cansel, Qt::DirectConnection);
+	connect(snapshot, &DataFile::updateProgressRange, dialog, &QProgressDialog::setRange);
+	connect(snapshot, &DataFile::updateProgressValue, dialog, &QProgressDialog::setValue);
+
+	connect(mSaveThread, &QThread::finished, this, [this, snapshot, filename, ok, changes, dialog]() {
+		const bool canceled = dialog && dialog->wasCanceled();
+		if (dialog) dialog->close();
+
+		// The file is left as it was, the user is told unless the saving was cancelled
+		if (!*ok) {
+			if (!canceled) QMessageBox::warning(this, tr("Recon Plotter"), tr("Unable to save '%1'.").arg(filename));
+			return;
+		}
+
+		// Changes made while saving keep the file modified
+		if (mDataFile != nullptr) {
+			mDataFile->setSaved(snapshot);
+			if (mDataFile->changes() == changes) mDataFile->setModified(false);
+			setWindowTitle(mDataFile->fileName() + "[*]");
+			addToRecent(filename);
+		}
+	});
+
+	connect(mSaveThread, &QThread::finished, snapshot, &QObject::deleteLater);
+	connect(mSaveThread, &QThread::finished, mSaveThread, &QObject::deleteLater);
+	mSaveThread->start();
+}
+
 void ChartWindow::refresh() {
-	mCustomPlot.clearGraphs();
+	if (mDataFile == nullptr) return;
+
 	mCustomPlot.xAxis->setRange(mDataFile->left(), mDataFile->right());
 	mCustomPlot.yAxis->setRange(mDataFile->bottom(), mDataFile->top());
 	mCustomPlot.legend->setVisible(true);
 
+	// Graphs of the channels left untouched are kept as is
 	for (qsizetype i = 0; i < mDataFile->analogSignalsCount(); i++) {
-		auto *signal = mDataFile->analogSignal(i);
-		if (signal->selected()) {
-			auto *graph = mCustomPlot.addGraph();
-			graph->setData(mDataFile->time(), signal->smoothed(), true);
-			graph->setName(signal->name(true));
-			graph->setPen(QPen(signal->color()));
-			graph->setVisible(true);
+		updateGraph(mDataFile->analogSignal(i));
+	}
+
+	sortLegend();
+
+	// Settings may have been changed since the graphs were added
+	const bool background = QSettings().value("BackgroundRendering", false).toBool();
+	for (auto *graph : qAsConst(mGraphs)) graph->setBackgroundRendering(background);
+
+	requestReplot();
+}
+
+void ChartWindow::requestReplot() {
+	mReplotsRequested++;
+	if (!mReplotTimer.isActive()) mReplotTimer.start();
+}
+
+// Adds, updates or removes the graph of the signal, returns true if the plot changed
+bool ChartWindow::updateGraph(AnalogSignal *signal) {
+	if ((mDataFile == nullptr) || (signal == nullptr)) return false;
+
+	auto *graph = mGraphs.value(signal, nullptr);
+
+	if (!signal->selected()) {
+		if (graph == nullptr) return false;
+		mGraphs.remove(signal);
+		mCustomPlot.removeGraph(graph);
+		return true;
+	}
+
+	if (graph == nullptr) {
+		graph = new SignalGraph(mCustomPlot.xAxis, mCustomPlot.yAxis);
+		graph->setData(&mDataFile->time(), signal);
+		graph->setBackgroundRendering(QSettings().value("BackgroundRendering", false).toBool());
+		mGraphs.insert(signal, graph);
+	}
+
+	// Samples are read from the signal on every replot, so new smoothing or scale needs no copy
+	graph->setName(signal->name(true));
+	graph->setPen(QPen(signal->color()));
+	return true;
+}
+
+// Keeps the legend in the order of the channels
+void ChartWindow::sortLegend() {
+	for (qsizetype i = 0; i < mDataFile->analogSignalsCount(); i++) {
+		auto *graph = mGraphs.value(mDataFile->analogSignal(i), nullptr);
+		if (graph != nullptr) {
+			graph->removeFromLegend();
+			graph->addToLegend();
 		}
 	}
+}
 
-	mCustomPlot.replot();
+void ChartWindow::clearGraphs() {
+	mGraphs.clear();
+	mCustomPlot.clearGraphs();
 }
 
 void ChartWindow::print() {
@@ -177,16 +381,3 @@ void ChartWindow::print() {
 		dialog->open();
 	}
 }
-
-QCPGraph *ChartWindow::findGraph(QString name) {
-	for (qsizetype i = 0; i < mCustomPlot.graphCount(); i++) {
-		auto graph = mCustomPlot.graph(i);
-		if (graph->name() == name) {
-			qDebug() << "Graph found:" << name;
-			return graph;
-		}
-	}
-
-	qDebug() << "Graph not found:" << name;
-	return nullptr;
-}
@@ -16,12 +16,18 @@
 
 #pragma once
 
+#include <QHash>
 #include <QMdiSubWindow>
 #include <QPointer>
 #include <QPrinter>
+#include <QThread>
+#include <QTimer>
 #include "datafile.h"
 #include "qcustomplot.h"
 
+class AnalogSignal;
+class SignalGraph;
+
 class ChartWindow : public QMdiSubWindow {
     Q_OBJECT
 
@@ -30,23 +36,44 @@ class ChartWindow : public QMdiSubWindow {
                          Qt::WindowFlags flags = Qt::WindowFlags());
 
     DataFile *dataFile() const { return mDataFile; }
+    QString pendingFile() const { return mPendingFile; }
+    bool isSaving() const { return !mSaveThread.isNull(); }
+    void setPendingFile(const QString filename);
     QString userFriendlyCurrentFile();
     void setDataFile(DataFile *datafile = nullptr);
+    void setLoadingFile(DataFile *datafile = nullptr);
+
+    quint64 replotsRequested() const { return mReplotsRequested; }
+    quint64 replotsPerformed() const { return mReplotsPerformed; }
 
    public slots:
     void save();
     void saveAs();
     void print();
     void refresh();
+    void requestReplot();
+    void appendData(const QVector<double> &time, const QVector<QVector<double>> &data, const QStringList &names);
 
    protected:
     void closeEvent(QCloseEvent *event) override;
 
    private:
     DataFile *mDataFile;
+    DataFile *mLoadingFile;
+    QString mPendingFile;   // File to be loaded into the window, until its data file is set
+    QPointer<QThread> mSaveThread;
     QCustomPlot mCustomPlot;
+    QTimer mPreviewTimer;
+    QTimer mReplotTimer;
+    quint64 mReplotsRequested;
+    quint64 mReplotsPerformed;
+    QVector<QCPGraph*> mPreviewGraphs;
+    QHash<const AnalogSignal*, SignalGraph*> mGraphs;
 
-    QCPGraph *findGraph(QString name);
+    bool updateGraph(AnalogSignal *signal);
+    void sortLegend();
+    void clearGraphs();
 
     bool maybeSave();
+    void saveFile(const QString filename);
 };
@@ -17,22 +17,100 @@
 #include <QByteArray>
 #include <QDebug>
 #include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
 #include <QDataStream>
+#include <QtConcurrent>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "utils.h"
 #include "analogsignal.h"
+#include "plotfile.h"
 #include "datafile.h"
 
 #define MAGIC        (quint32) 0x504C4F54
-#define VERSION      (quint32) 1
+#define VERSION      (quint32) 2
+
+// Tags of the optional sections of the directory. They are odd, so they never
+// match the length of the title which starts the next directory in the file.
+#define SECTION_PYRAMIDS    (quint32) 0x50595231   // "PYR1"
+#define SECTION_STATISTICS  (quint32) 0x53544131   // "STA1"
+
+// The file is saved entirely when the directories not used any more take over 1/DEAD_DIRECTORIES_PART of it
+#define DEAD_DIRECTORIES_PART  8
+
+// Writes the buffered data and makes sure it is stored on the disk
+static bool syncFile(QFile &file)
+{
+	if (!file.flush()) return false;
+#ifdef Q_OS_WIN
+	return _commit(file.handle()) == 0;
+#else
+	return fsync(file.handle()) == 0;
+#endif
+}
 
 DataFile::DataFile(QObject *parent)
 	: QObject(parent)
 	, mFileName("")
 	, mTime()
 	, mModified(false)
-	, mCansel(false)
+	, mCompressed(true)
+	, mStorePyramids(true)
+	, mChanges(0)
+	, mBlocksCompressed(false)
+	, mBlocksPyramids(false)
+	, mDirectory(0)
+	, mBlocksWritten(false)
+	, mCansel(0)
 {}
 
+// Copy of the document to be saved in the worker thread. Samples are shared
+// with this file, so the copy is cheap and stays the same if this file is changed.
+DataFile *DataFile::snapshot() const
+{
+	auto *datafile = new DataFile();
+
+	datafile->mFileName = mFileName;
+	datafile->mTitle = mTitle;
+	datafile->mDevice = mDevice;
+	datafile->mOriginalFileName = mOriginalFileName;
+	datafile->mLabelX = mLabelX;
+	datafile->mLabelY = mLabelY;
+	datafile->mLeft = mLeft;
+	datafile->mRight = mRight;
+	datafile->mBottom = mBottom;
+	datafile->mTop = mTop;
+	datafile->mMinX = mMinX;
+	datafile->mMaxX = mMaxX;
+	datafile->mMinY = mMinY;
+	datafile->mMaxY = mMaxY;
+	datafile->mTime = mTime;
+	datafile->mModified = mModified;
+	datafile->mCompressed = mCompressed;
+	datafile->mStorePyramids = mStorePyramids;
+	datafile->mChanges = mChanges;
+	datafile->mTimeBlocks = mTimeBlocks;
+	datafile->mSignalBlocks = mSignalBlocks;
+	datafile->mMinimumBlocks = mMinimumBlocks;
+	datafile->mMaximumBlocks = mMaximumBlocks;
+	datafile->mRevisions = mRevisions;
+	datafile->mBlocksCompressed = mBlocksCompressed;
+	datafile->mBlocksPyramids = mBlocksPyramids;
+	datafile->mDirectory = mDirectory;
+
+	foreach (auto *signal, mAnalogSignals) {
+		datafile->mAnalogSignals.append(signal->clone(&datafile->mTime, datafile));
+	}
+
+	return datafile;
+}
+
+// Limits of the time axis and of all channels, the signals which
+// are not loaded keep the statistics read from the file
 void DataFile::calculateLimits()
 {
 	mMinY = mMinX = qInf();
@@ -43,13 +121,26 @@ void DataFile::calculateLimits()
 		mMaxX = mTime.at(mTime.count() - 1);
 	}
 
+	// Channels are processed in parallel
+	QtConcurrent::blockingMap(mAnalogSignals, [](AnalogSignal *signal) {
+		signal->calculateLimits();
+	});
+
 	for (qsizetype i = 0; i < mAnalogSignals.count(); i++) {
-		mAnalogSignals.at(i)->calculateLimits();
 		mMinY = qMin(mMinY, mAnalogSignals.at(i)->minY());
 		mMaxY = qMax(mMaxY, mAnalogSignals.at(i)->maxY());
 	}
 }
 
+// Looks for the compact encoding of the time axis and of all channels
+void DataFile::chooseEncoding()
+{
+	mTime.chooseEncoding();
+	QtConcurrent::blockingMap(mAnalogSignals, [](AnalogSignal *signal) {
+		signal->chooseEncoding();
+	});
+}
+
 void DataFile::resetWindow()
 {
 	if (!qIsFinite(mMinX) || !qIsFinite(mMaxX) || !qIsFinite(mMinY) || !qIsFinite(mMaxY))
@@ -66,25 +157,155 @@ bool DataFile::save()
 	return saveAs(mFileName);
 }
 
-bool DataFile::saveAs(QString filename)
+QVector<quint64> DataFile::revisions() const
 {
-	QFile datafile(filename);
-	if (!datafile.open(QIODevice::WriteOnly)) {
-		qDebug() << "Unable to open: " << filename;
-		return false;
+	QVector<quint64> result;
+	foreach (auto *signal, mAnalogSignals) result.append(signal->revision());
+	return result;
+}
+
+// Copies the description of the file saved from the snapshot of this file
+void DataFile::setSaved(const DataFile *snapshot)
+{
+	mFileName = snapshot->mFileName;
+	mTimeBlocks = snapshot->mTimeBlocks;
+	mSignalBlocks = snapshot->mSignalBlocks;
+	mMinimumBlocks = snapshot->mMinimumBlocks;
+	mMaximumBlocks = snapshot->mMaximumBlocks;
+	mBlocksCompressed = snapshot->mBlocksCompressed;
+	mBlocksPyramids = snapshot->mBlocksPyramids;
+	mRevisions = snapshot->mRevisions;
+	mDirectory = snapshot->mDirectory;
+
+	// Signals keep reading the same blocks if only the metadata was saved
+	if (snapshot->mBlocksWritten) moveSources();
+}
+
+// Signals which are not loaded yet are read from the saved file,
+// so the file they were read from is released when it is replaced
+void DataFile::moveSources()
+{
+	if ((mSignalBlocks.count() != mAnalogSignals.count()) || (mRevisions.count() != mAnalogSignals.count())) return;
+
+	if (!QFileInfo::exists(mFileName)) return;
+	auto source = PlotFileReaderPtr::create(mFileName, !mBlocksCompressed);
+
+	for (qsizetype i = 0; i < mAnalogSignals.count(); i++) {
+		auto *signal = mAnalogSignals.at(i);
+		if (signal->revision() != mRevisions.at(i)) continue;
+		signal->moveSource(source, mSignalBlocks.at(i),
+						   mBlocksPyramids ? mMinimumBlocks.at(i) : PlotBlockList(),
+						   mBlocksPyramids ? mMaximumBlocks.at(i) : PlotBlockList());
 	}
+}
 
-	QByteArray data;
+// Readers of the file shared by the time axis and the signals
+QVector<PlotFileReaderPtr> DataFile::sources(QString filename) const
+{
+	QVector<PlotFileReaderPtr> result;
+	auto append = [&result, &filename](const PlotFileReaderPtr &source) {
+		if (!source.isNull() && !result.contains(source) && (QFileInfo(source->fileName()) == QFileInfo(filename))) result.append(source);
+	};
 
-	QDataStream datastream(&data, QIODevice::WriteOnly);
-	datastream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+	append(mTime.samples().source());
+	foreach (auto *signal, mAnalogSignals) {
+		for (const auto &source : signal->sources()) append(source);
+	}
 
-	datastream
-		<< MAGIC
-		<< VERSION;
+	return result;
+}
+
+bool DataFile::isMapped(QString filename) const
+{
+	for (const auto &source : sources(filename)) {
+		if (source->isMapped()) return true;
+	}
+	return false;
+}
+
+// Samples are read into the memory, so the file they are mapped from isn't kept open
+bool DataFile::detach()
+{
+	foreach (auto *signal, mAnalogSignals) {
+		if (!signal->detach()) return false;
+	}
+	mTime.detach();
+	return true;
+}
+
+// The mapped file can't be replaced on Windows, so the samples mapped from the file
+// which is going to be replaced are read into the memory. Files which are not mapped
+// are opened only while they are read.
+bool DataFile::release(QString filename)
+{
+	if (canSaveMetadataOnly(filename) || !isMapped(filename)) return true;
+	return detach();
+}
+
+// Samples weren't changed since they were written to the file, so only the metadata is to be saved
+bool DataFile::canSaveMetadataOnly(QString filename) const
+{
+	if ((mRevisions.count() != mAnalogSignals.count()) || (mSignalBlocks.count() != mAnalogSignals.count())) return false;
+	if (QFileInfo(filename) != QFileInfo(mFileName)) return false;
+	if ((mCompressed != mBlocksCompressed) || (mStorePyramids != mBlocksPyramids)) return false;
+
+	for (qsizetype i = 0; i < mAnalogSignals.count(); i++) {
+		if (mAnalogSignals.at(i)->revision() != mRevisions.at(i)) return false;
+	}
+
+	// Directories between the last block and the current one are dropped by the saving entirely
+	quint64 blocksEnd = sizeof(MAGIC) + sizeof(VERSION) + sizeof(mDirectory);
+	auto findEnd = [&blocksEnd](const PlotBlockList &blocks) {
+		for (const auto &block : blocks) blocksEnd = qMax(blocksEnd, block.offset + block.size);
+	};
+	findEnd(mTimeBlocks);
+	for (const auto &blocks : mSignalBlocks) findEnd(blocks);
+	for (const auto &blocks : mMinimumBlocks) findEnd(blocks);
+	for (const auto &blocks : mMaximumBlocks) findEnd(blocks);
+
+	return (mDirectory >= blocksEnd) && ((mDirectory - blocksEnd) * DEAD_DIRECTORIES_PART <= mDirectory);
+}
 
+// New directory is appended to the file and refers to the blocks already stored in it.
+// The header is pointed to it only when it is stored on the disk, so the header
+// points to the previous directory if the saving is interrupted.
+bool DataFile::saveMetadata()
+{
+	QFile datafile(mFileName);
+	if (!datafile.open(QIODevice::ReadWrite)) {
+		qDebug() << "Unable to open: " << mFileName;
+		return false;
+	}
+
+	QDataStream datastream(&datafile);
 	datastream.setVersion(QDataStream::Qt_5_0);
+	datastream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+	const quint64 directory = static_cast<quint64>(datafile.size());
+	bool ok = datafile.seek(static_cast<qint64>(directory)) &&
+		writeDirectory(datastream, mTimeBlocks, mSignalBlocks, mMinimumBlocks, mMaximumBlocks, mBlocksPyramids) &&
+		syncFile(datafile) &&
+		datafile.seek(sizeof(MAGIC) + sizeof(VERSION));
+
+	if (ok) {
+		datastream << directory;
+		ok = (datastream.status() == QDataStream::Ok) && syncFile(datafile);
+	}
+
+	if (ok) {
+		mDirectory = directory;
+		mBlocksWritten = false;
+		setModified(false);
+		return true;
+	}
 
+	qDebug() << "Unable to save: " << mFileName;
+	return false;
+}
+
+bool DataFile::writeDirectory(QDataStream &datastream, const PlotBlockList &timeBlocks, const QVector<PlotBlockList> &signalBlocks,
+							  const QVector<PlotBlockList> &minimumBlocks, const QVector<PlotBlockList> &maximumBlocks, bool pyramids) const
+{
 	datastream
 		<< mTitle
 		<< mDevice
@@ -99,23 +320,159 @@ bool DataFile::saveAs(QString filename)
 		<< mMaxX
 		<< mMinY
 		<< mMaxY
-		<< static_cast<quint64>(mTime.count());
+		<< timeBlocks
+		<< static_cast<quint64>(mAnalogSignals.count());
+
+	for (qsizetype i = 0; i < mAnalogSignals.count(); i++) {
+		mAnalogSignals.at(i)->saveMetadataToStream(datastream);
+		datastream << signalBlocks.at(i);
+	}
 
-	for (qreal value : qAsConst(mTime)) {
-		datastream << value;
+	// Optional sections follow the channels, each one is the tag and the data of the section
+	QByteArray statistics;
+	QDataStream statisticsstream(&statistics, QIODevice::WriteOnly);
+	statisticsstream.setVersion(QDataStream::Qt_5_0);
+	statisticsstream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+	foreach (auto *signal, mAnalogSignals) signal->saveStatisticsToStream(statisticsstream);
+	datastream << SECTION_STATISTICS << statistics;
+
+	if (pyramids) {
+		QByteArray levels;
+		QDataStream levelsstream(&levels, QIODevice::WriteOnly);
+		levelsstream.setVersion(QDataStream::Qt_5_0);
+		levelsstream << static_cast<quint32>(Pyramid::Factor);
+		for (qsizetype i = 0; i < mAnalogSignals.count(); i++) {
+			levelsstream << minimumBlocks.at(i) << maximumBlocks.at(i);
+		}
+		datastream << SECTION_PYRAMIDS << levels;
 	}
 
-	datastream << static_cast<quint64>(mAnalogSignals.count());
+	return datastream.status() == QDataStream::Ok;
+}
+
+bool DataFile::saveAs(QString filename)
+{
+	if (canSaveMetadataOnly(filename)) return saveMetadata();
+	if (!release(filename)) {
+		qDebug() << "Unable to release: " << filename;
+		return false;
+	}
+
+	// The file is replaced only when all of it is written, signals
+	// which are not loaded yet are read from it until then
+	const auto saved = revisions();
+	QSaveFile datafile(filename);
+	if (!datafile.open(QIODevice::WriteOnly)) {
+		qDebug() << "Unable to open: " << filename;
+		return false;
+	}
+
+	QDataStream datastream(&datafile);
+	datastream.setVersion(QDataStream::Qt_5_0);
+	datastream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+	// Header, the directory offset is updated at the end
+	datastream
+		<< MAGIC
+		<< VERSION
+		<< static_cast<quint64>(0);
+
+	// Samples
+	PlotBlockList timeBlocks;
+	QVector<PlotBlockList> signalBlocks(mAnalogSignals.count());
+
+	// Compressed files keep samples in the compact encoding, uncompressed
+	// ones keep doubles to be mapped. The uniform time axis is stored as
+	// its encoding only.
+	const PlotCodec codec = mCompressed ? PlotCodec::Zlib : PlotCodec::Raw;
+	if (mTime.encoding().type == PlotEncoding::Double) mTime.chooseEncoding();
+
+	// Progress is counted in blocks, the saving is stopped when it is cancelled
+	qsizetype total = blocksCount(mTime.count());
 	foreach (auto *signal, mAnalogSignals) {
-		signal->saveToStream(datastream);
+		total += blocksCount(signal->dataCount());
+		if (mStorePyramids) total += 2 * blocksCount(Pyramid::levels(signal->dataCount()).last());
+	}
+
+	qsizetype written = 0;
+	mCansel.storeRelaxed(0);
+	emit updateProgressRange(0, static_cast<int>(total));
+	emit updateProgressShow(true);
+	emit updateProgressValue(0);
+	auto progress = [this, &written]() {
+		emit updateProgressValue(static_cast<int>(++written));
+		return !mCansel.loadRelaxed();
+	};
+
+	const double *time = mTime.isUniform() ? nullptr : mTime.samples().constData();
+	const auto timeEncoding = (mCompressed || mTime.isUniform()) ? mTime.encoding() : SampleEncoding();
+	bool ok = writeBlocks(datafile, time, mTime.count(), timeBlocks, codec, timeEncoding, progress);
+	for (qsizetype i = 0; ok && (i < mAnalogSignals.count()); i++) {
+		auto *signal = mAnalogSignals.at(i);
+		const auto &samples = signal->samples();
+		if (mCompressed && (signal->encoding().type == PlotEncoding::Double)) signal->chooseEncoding();
+		ok = writeBlocks(datafile, samples.constData(), samples.count(), signalBlocks[i], codec, mCompressed ? signal->encoding() : SampleEncoding(), progress);
 	}
 
-	if (datafile.write(qCompress(data)) > 0) {
+	// Pyramids of the not smoothed samples, so the overview is shown without reading all samples
+	QVector<PlotBlockList> minimumBlocks(mAnalogSignals.count());
+	QVector<PlotBlockList> maximumBlocks(mAnalogSignals.count());
+	for (qsizetype i = 0; ok && mStorePyramids && (i < mAnalogSignals.count()); i++) {
+		auto *signal = mAnalogSignals.at(i);
+		const auto &samples = signal->samples();
+
+		Pyramid built;
+		const Pyramid *pyramid = &built;
+		if (signal->smooth() <= 1) {
+			pyramid = &signal->pyramid();
+		} else {
+			built.build(samples.constData(), samples.count());
+		}
+
+		// Limits are samples, so they fit the encoding of the samples
+		const auto encoding = (mCompressed && (signal->encoding().type != PlotEncoding::Uniform)) ? signal->encoding() : SampleEncoding();
+		ok = writeBlocks(datafile, pyramid->minimums().constData(), pyramid->minimums().count(), minimumBlocks[i], codec, encoding, progress) &&
+			writeBlocks(datafile, pyramid->maximums().constData(), pyramid->maximums().count(), maximumBlocks[i], codec, encoding, progress);
+	}
+
+	emit updateProgressShow(false);
+
+	// Directory
+	const quint64 directory = static_cast<quint64>(datafile.pos());
+	ok = ok && writeDirectory(datastream, timeBlocks, signalBlocks, minimumBlocks, maximumBlocks, mStorePyramids);
+
+	// Update the directory offset
+	ok = ok && datafile.seek(sizeof(MAGIC) + sizeof(VERSION));
+	if (ok) datastream << directory;
+	ok = ok && (datastream.status() == QDataStream::Ok);
+
+	// Readers of the replaced file don't open it while it is replaced,
+	// the blocks they are going to read are not in the new file
+	const auto readers = sources(filename);
+	for (const auto &reader : readers) reader->lock();
+	ok = ok && datafile.commit();
+	for (const auto &reader : readers) {
+		if (ok) reader->setReplaced();
+		reader->unlock();
+	}
+
+	if (ok) {
 		mFileName = filename;
+		mTimeBlocks = timeBlocks;
+		mSignalBlocks = signalBlocks;
+		mMinimumBlocks = minimumBlocks;
+		mMaximumBlocks = maximumBlocks;
+		mBlocksCompressed = mCompressed;
+		mBlocksPyramids = mStorePyramids;
+		mRevisions = saved;
+		mDirectory = directory;
+		mBlocksWritten = true;
+		moveSources();
 		setModified(false);
 		return true;
 	}
 
+	qDebug() << "Unable to save: " << filename;
 	return false;
 }
 
@@ -127,6 +484,52 @@ bool DataFile::open(QString filename)
 		return false;
 	}
 
+	foreach (auto signal, mAnalogSignals) {
+		if (signal != nullptr) signal->deleteLater();
+		mAnalogSignals.removeOne(signal);
+	}
+
+	mTimeBlocks.clear();
+	mSignalBlocks.clear();
+	mMinimumBlocks.clear();
+	mMaximumBlocks.clear();
+	mRevisions.clear();
+	mDirectory = 0;
+
+	// Version 1 file is compressed entirely, so it has no magic at the beginning
+	QDataStream datastream(&datafile);
+	quint32 magic;
+	datastream >> magic;
+	qDebug() << "Magic value: 0x" << Qt::hex << magic;
+
+	datafile.seek(0);
+	const bool version2 = magic == MAGIC;
+	if (!(version2 ? openVersion2(datafile) : openVersion1(datafile))) return false;
+
+	// Time axis of the older files is stored sample by sample
+	mTime.chooseEncoding();
+
+	if (qIsInf(mMinX) || qIsInf(mMaxX) || qIsInf(mMinY) || qIsInf(mMaxY) ||
+		qIsNaN(mMinX) || qIsNaN(mMaxX) || qIsNaN(mMinY) || qIsNaN(mMaxY)) {
+			calculateLimits();
+			resetWindow();
+	}
+
+	mFileName = filename;
+	setModified(false);
+
+	// Samples of the version 2 file are kept in place while only the metadata is changed
+	if (version2) {
+		mRevisions = revisions();
+		mCompressed = mBlocksCompressed;
+		mStorePyramids = mBlocksPyramids;
+	}
+
+	return true;
+}
+
+bool DataFile::openVersion1(QFile &datafile)
+{
 	QByteArray data = qUncompress(datafile.readAll());
 	QDataStream datastream(&data, QIODevice::ReadOnly);
 	datastream.setFloatingPointPrecision(QDataStream::DoublePrecision);
@@ -137,12 +540,11 @@ bool DataFile::open(QString filename)
 	qreal value;
 
 	datastream >> magic;
-	qDebug() << "Magic value: 0x" << Qt::hex << magic;
 	if (magic != MAGIC) return false;
 
 	datastream >> version;
 	qDebug() << "Version: " << version;
-	if (version != VERSION) return false;
+	if (version != 1) return false;
 
 	datastream.setVersion(QDataStream::Qt_5_0);
 
@@ -162,34 +564,147 @@ bool DataFile::open(QString filename)
 		>> mMaxY
 		>> count;
 
-	mTime.clear();
-	mTime.reserve(count);
+	QVector<double> time;
+	time.reserve(count);
 	for (int i = count; i; i--) {
 		datastream >> value;
-		mTime.append(value);
-	}
-
-	foreach (auto signal, mAnalogSignals) {
-		if (signal != nullptr) signal->deleteLater();
-		mAnalogSignals.removeOne(signal);
+		time.append(value);
 	}
+	mTime = TimeAxis(Samples(time));
 
 	datastream >> count;
 	for (int i = count; i; i--) {
-		AnalogSignal *signal = new AnalogSignal();
+		AnalogSignal *signal = new AnalogSignal(this);
 		signal->loadFromStream(datastream);
 		signal->setTime(&mTime);
 		mAnalogSignals.append(signal);
 	}
 
-	if (qIsInf(mMinX) || qIsInf(mMaxX) || qIsInf(mMinY) || qIsInf(mMaxY) ||
-		qIsNaN(mMinX) || qIsNaN(mMaxX) || qIsNaN(mMinY) || qIsNaN(mMaxY)) {
-			calculateLimits();
-			resetWindow();
+	return datastream.status() == QDataStream::Ok;
+}
+
+bool DataFile::openVersion2(QFile &datafile)
+{
+	QDataStream datastream(&datafile);
+	datastream.setVersion(QDataStream::Qt_5_0);
+	datastream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+	quint32 magic;
+	quint32 version;
+	quint64 directory;
+	quint64 count;
+	PlotBlockList blocks;
+
+	datastream >> magic >> version >> directory;
+	qDebug() << "Version: " << version;
+	if ((magic != MAGIC) || (version != VERSION)) return false;
+
+	if (!datafile.seek(static_cast<qint64>(directory))) return false;
+	mDirectory = directory;
+
+	datastream
+		>> mTitle
+		>> mDevice
+		>> mOriginalFileName
+		>> mLabelX
+		>> mLabelY
+		>> mLeft
+		>> mRight
+		>> mBottom
+		>> mTop
+		>> mMinX
+		>> mMaxX
+		>> mMinY
+		>> mMaxY
+		>> blocks
+		>> count;
+
+	if (datastream.status() != QDataStream::Ok) return false;
+
+	// Channels description, samples are loaded when they are needed first time
+	QVector<PlotBlockList> signalsBlocks;
+	for (quint64 i = count; i; i--) {
+		PlotBlockList signalBlocks;
+		AnalogSignal *signal = new AnalogSignal(this);
+		signal->loadMetadataFromStream(datastream);
+		datastream >> signalBlocks;
+		signal->setTime(&mTime);
+		mAnalogSignals.append(signal);
+		signalsBlocks.append(signalBlocks);
+		if (datastream.status() != QDataStream::Ok) return false;
 	}
 
-	mFileName = filename;
-	setModified(false);
+	// Optional sections, the reading stops at the first unknown one,
+	// e.g. at the rest of the directory which was not written entirely.
+	// Pyramids are built again if they are missing.
+	QVector<PlotBlockList> minimumBlocks, maximumBlocks;
+	bool pyramids = false;
+	while (!datastream.atEnd()) {
+		quint32 tag;
+		QByteArray section;
+		datastream >> tag;
+		if ((tag != SECTION_STATISTICS) && (tag != SECTION_PYRAMIDS)) break;
+		datastream >> section;
+		if (datastream.status() != QDataStream::Ok) break;
+
+		QDataStream sectionstream(section);
+		sectionstream.setVersion(QDataStream::Qt_5_0);
+		sectionstream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+		if (tag == SECTION_STATISTICS) {
+			foreach (auto *signal, mAnalogSignals) signal->loadStatisticsFromStream(sectionstream);
+			continue;
+		}
+
+		quint32 factor = 0;
+		sectionstream >> factor;
+		if (factor != Pyramid::Factor) continue;
+
+		QVector<PlotBlockList> minimums(mAnalogSignals.count()), maximums(mAnalogSignals.count());
+		for (qsizetype i = 0; i < mAnalogSignals.count(); i++) sectionstream >> minimums[i] >> maximums[i];
+		if (sectionstream.status() != QDataStream::Ok) continue;
+
+		minimumBlocks = minimums;
+		maximumBlocks = maximums;
+		pyramids = true;
+	}
+
+	// Blocks are kept to save the metadata only, the codec of the first block tells if the file is compressed
+	mTimeBlocks = blocks;
+	mSignalBlocks = signalsBlocks;
+	mBlocksPyramids = pyramids;
+	mMinimumBlocks = minimumBlocks;
+	mMaximumBlocks = maximumBlocks;
+	mBlocksCompressed = false;
+	foreach (const auto &list, QVector<PlotBlockList>() << blocks << signalsBlocks) {
+		if (!list.isEmpty()) {
+			mBlocksCompressed = list.first().codec == PlotCodec::Zlib;
+			break;
+		}
+	}
+
+	// The compressed file isn't mapped, so it isn't kept open
+	auto source = PlotFileReaderPtr::create(datafile.fileName(), !mBlocksCompressed);
+	for (qsizetype i = 0; i < mAnalogSignals.count(); i++) {
+		mAnalogSignals.at(i)->setSource(source, signalsBlocks.at(i));
+		if (pyramids) mAnalogSignals.at(i)->setPyramidSource(source, minimumBlocks.at(i), maximumBlocks.at(i));
+	}
+
+	// Time, the uniform axis is calculated
+	SampleEncoding uniform;
+	if (readUniform(datafile, blocks, uniform)) {
+		mTime = TimeAxis(uniform, static_cast<qsizetype>(samplesCount(blocks)));
+		return true;
+	}
+
+	const double *mapped = source->map(blocks);
+	if (mapped != nullptr) {
+		mTime = TimeAxis(Samples(source, mapped, static_cast<qsizetype>(samplesCount(blocks))));
+		return true;
+	}
 
+	QVector<double> time;
+	if (!readBlocks(datafile, blocks, time)) return false;
+	mTime = TimeAxis(Samples(time));
 	return true;
 }
@@ -19,7 +19,11 @@
 #include <QObject>
 #include <QFile>
 #include <QList>
+#include <QAtomicInt>
+#include <QDataStream>
 #include "analogsignal.h"
+#include "samples.h"
+#include "timeaxis.h"
 
 class DataFile : public QObject
 {
@@ -31,7 +35,7 @@ public:
     auto fileName()       const {return mFileName;}
     auto title()          const {return mTitle;}
     auto device()         const {return mDevice;}
-	auto &time()                {return mTime;}
+	auto &time()          const {return mTime;}
     auto minX()           const {return mMinX;}
     auto maxX()           const {return mMaxX;}
     auto minY()           const {return mMinY;}
@@ -42,6 +46,9 @@ public:
     auto top()            const {return mTop;}
     bool isRenameNeeded() const {return !mFileName.endsWith(".plot");}
 	bool isModified()     const {return mModified;}
+	bool isCompressed()   const {return mCompressed;}
+	bool storePyramids()  const {return mStorePyramids;}
+	quint64 changes()     const {return mChanges;}
 
 	auto analogSignalsCount() {return mAnalogSignals.count();}
 	auto *analogSignal(int channel) {return mAnalogSignals[channel];}
@@ -49,11 +56,21 @@ public:
 	bool save();
 	bool saveAs(QString filename);
 	bool open(QString filename);
+	DataFile *snapshot() const;
+	void setSaved(const DataFile *snapshot);
+	bool canSaveMetadataOnly(QString filename) const;
+	bool isMapped(QString filename) const;
+	bool release(QString filename);
 	void calculateLimits();
 	void resetWindow();
+	void chooseEncoding();
+
+	void setCompressed(bool compressed) {mCompressed = compressed;}
+	void setStorePyramids(bool store) {mStorePyramids = store;}
 
     void setModified(bool modified=true) {
         mModified = modified;
+        if (modified) mChanges++;
         emit modifiedChanged(modified);
 	}
 
@@ -71,10 +88,55 @@ public:
         }
     }
 
+    void setName(qsizetype channel, QString name) {
+        if (channel < mAnalogSignals.count()) {
+            mAnalogSignals.at(channel)->setName(name);
+            emit signalChanged(channel);
+        }
+    }
+
+    void setUnit(qsizetype channel, QString unit) {
+        if (channel < mAnalogSignals.count()) {
+            mAnalogSignals.at(channel)->setUnit(unit);
+            emit signalChanged(channel);
+        }
+    }
+
+    void setFactor(qsizetype channel, qreal factor) {
+        if (channel < mAnalogSignals.count()) {
+            mAnalogSignals.at(channel)->setFactor(factor);
+            emit signalChanged(channel);
+        }
+    }
+
+    void setScale(qsizetype channel, qreal scale) {
+        if (channel < mAnalogSignals.count()) {
+            mAnalogSignals.at(channel)->setScale(scale);
+            emit signalChanged(channel);
+        }
+    }
+
+    void setSmooth(qsizetype channel, quint64 smooth) {
+        if (channel < mAnalogSignals.count()) {
+            mAnalogSignals.at(channel)->setSmooth(smooth);
+            emit signalChanged(channel);
+        }
+    }
+
 public slots:
-	void cansel() {mCansel = true;}
+	void cansel() {mCansel.storeRelaxed(1);}
 
 protected:
+	bool openVersion1(QFile &datafile);
+	bool openVersion2(QFile &datafile);
+	bool saveMetadata();
+	bool writeDirectory(QDataStream &datastream, const PlotBlockList &timeBlocks, const QVector<PlotBlockList> &signalBlocks,
+						const QVector<PlotBlockList> &minimumBlocks, const QVector<PlotBlockList> &maximumBlocks, bool pyramids) const;
+	QVector<quint64> revisions() const;
+	QVector<PlotFileReaderPtr> sources(QString filename) const;
+	bool detach();
+	void moveSources();
+
 	QString mFileName;
 	QString mTitle;
 	QString mDevice;
@@ -90,9 +152,23 @@ protected:
 	double mMinY;
 	double mMaxY;
 	QList<AnalogSignal*> mAnalogSignals;
-	QVector<double> mTime;
+	TimeAxis mTime;
     bool mModified;
-	bool mCansel;
+	bool mCompressed;
+	bool mStorePyramids;
+	quint64 mChanges;           // Count of the modifications
+
+	// Blocks of the samples stored in the file, so the metadata may be saved alone
+	PlotBlockList mTimeBlocks;
+	QVector<PlotBlockList> mSignalBlocks;
+	QVector<PlotBlockList> mMinimumBlocks;
+	QVector<PlotBlockList> mMaximumBlocks;
+	QVector<quint64> mRevisions;    // Revisions of the signals stored in the blocks
+	bool mBlocksCompressed;
+	bool mBlocksPyramids;
+	quint64 mDirectory;         // Offset of the directory the header points to
+	bool mBlocksWritten;        // The last saving wrote the blocks, not only the metadata
+	QAtomicInt mCansel;
 
 signals:
 	void updateProgressShow(bool state);
@@ -102,4 +178,5 @@ signals:
 	void modifiedChanged(bool modified);
     void selectedChanged(qsizetype channel, bool state);
     void colorChanged(qsizetype channel, QColor color);
+    void signalChanged(qsizetype channel);
 };
@@ -0,0 +1,355 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <QtMath>
+#include "kernels.h"
+
+#if defined(Q_PROCESSOR_X86)
+#define KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile the intrinsics only for the enabled instruction sets
+#if defined(KERNELS_X86) && defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX  __attribute__((target("avx")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX
+#endif
+
+namespace {
+
+// Sums are accumulated in 4 lanes by all implementations, so they are added in the same order
+constexpr qsizetype Lanes = 4;
+
+struct Implementation
+{
+	void (*scale)(double *data, qsizetype count, double multiplier);
+	void (*negate)(double *data, qsizetype count);
+	void (*limits)(const double *data, qsizetype count, double &min, double &max);
+	void (*average)(const double *sums, qsizetype begin, qsizetype end, qsizetype window, double *result);
+	void (*moments)(const double *data, qsizetype count, double *sums, double *squares);
+};
+
+// Scalar implementation, it also handles the tails of the vectorised ones
+
+void scaleScalar(double *data, qsizetype count, double multiplier)
+{
+	for (qsizetype i = 0; i < count; i++) data[i] = data[i] * multiplier;
+}
+
+void negateScalar(double *data, qsizetype count)
+{
+	for (qsizetype i = 0; i < count; i++) data[i] = -data[i];
+}
+
+// Same comparisons as MINPD and MAXPD, which return the second operand for NaN
+void limitsScalar(const double *data, qsizetype count, double &min, double &max)
+{
+	for (qsizetype i = 0; i < count; i++) {
+		min = (data[i] < min) ? data[i] : min;
+		max = (data[i] > max) ? data[i] : max;
+	}
+}
+
+void averageScalar(const double *sums, qsizetype begin, qsizetype end, qsizetype window, double *result)
+{
+	for (qsizetype i = begin; i < end; i++) {
+		result[i] = (sums[i + 1] - sums[i + 1 - window]) / static_cast<double>(window);
+	}
+}
+
+void momentsScalar(const double *data, qsizetype count, double *sums, double *squares)
+{
+	for (qsizetype i = 0; i + Lanes <= count; i += Lanes) {
+		for (qsizetype lane = 0; lane < Lanes; lane++) {
+			sums[lane] += data[i + lane];
+			squares[lane] += data[i + lane] * data[i + lane];
+		}
+	}
+}
+
+const Implementation scalar = {scaleScalar, negateScalar, limitsScalar, averageScalar, momentsScalar};
+
+#if defined(KERNELS_X86)
+
+// SSE2 implementation
+
+TARGET_SSE2 void scaleSse2(double *data, qsizetype count, double multiplier)
+{
+	const __m128d factor = _mm_set1_pd(multiplier);
+	qsizetype i = 0;
+	for (; i + 2 <= count; i += 2) _mm_storeu_pd(data + i, _mm_mul_pd(_mm_loadu_pd(data + i), factor));
+	scaleScalar(data + i, count - i, multiplier);
+}
+
+TARGET_SSE2 void negateSse2(double *data, qsizetype count)
+{
+	const __m128d sign = _mm_set1_pd(-0.0);
+	qsizetype i = 0;
+	for (; i + 2 <= count; i += 2) _mm_storeu_pd(data + i, _mm_xor_pd(_mm_loadu_pd(data + i), sign));
+	negateScalar(data + i, count - i);
+}
+
+TARGET_SSE2 void limitsSse2(const double *data, qsizetype count, double &min, double &max)
+{
+	__m128d lower = _mm_set1_pd(min);
+	__m128d upper = _mm_set1_pd(max);
+	qsizetype i = 0;
+	for (; i + 2 <= count; i += 2) {
+		const __m128d value = _mm_loadu_pd(data + i);
+		lower = _mm_min_pd(value, lower);
+		upper = _mm_max_pd(value, upper);
+	}
+
+	double lowers[2], uppers[2];
+	_mm_storeu_pd(lowers, lower);
+	_mm_storeu_pd(uppers, upper);
+	for (int lane = 0; lane < 2; lane++) {
+		min = (lowers[lane] < min) ? lowers[lane] : min;
+		max = (uppers[lane] > max) ? uppers[lane] : max;
+	}
+	limitsScalar(data + i, count - i, min, max);
+}
+
+TARGET_SSE2 void averageSse2(const double *sums, qsizetype begin, qsizetype end, qsizetype window, double *result)
+{
+	const __m128d width = _mm_set1_pd(static_cast<double>(window));
+	qsizetype i = begin;
+	for (; i + 2 <= end; i += 2) {
+		const __m128d sum = _mm_sub_pd(_mm_loadu_pd(sums + i + 1), _mm_loadu_pd(sums + i + 1 - window));
+		_mm_storeu_pd(result + i, _mm_div_pd(sum, width));
+	}
+	averageScalar(sums, i, end, window, result);
+}
+
+TARGET_SSE2 void momentsSse2(const double *data, qsizetype count, double *sums, double *squares)
+{
+	__m128d sumsLow = _mm_loadu_pd(sums), sumsHigh = _mm_loadu_pd(sums + 2);
+	__m128d squaresLow = _mm_loadu_pd(squares), squaresHigh = _mm_loadu_pd(squares + 2);
+	for (qsizetype i = 0; i + Lanes <= count; i += Lanes) {
+		const __m128d low = _mm_loadu_pd(data + i);
+		const __m128d high = _mm_loadu_pd(data + i + 2);
+		sumsLow = _mm_add_pd(sumsLow, low);
+		sumsHigh = _mm_add_pd(sumsHigh, high);
+		squaresLow = _mm_add_pd(squaresLow, _mm_mul_pd(low, low));
+		squaresHigh = _mm_add_pd(squaresHigh, _mm_mul_pd(high, high));
+	}
+	_mm_storeu_pd(sums, sumsLow);
+	_mm_storeu_pd(sums + 2, sumsHigh);
+	_mm_storeu_pd(squares, squaresLow);
+	_mm_storeu_pd(squares + 2, squaresHigh);
+}
+
+const Implementation sse2 = {scaleSse2, negateSse2, limitsSse2, averageSse2, momentsSse2};
+
+// AVX implementation, FMA is not used, so the results are the same as of the other ones
+
+TARGET_AVX void scaleAvx(double *data, qsizetype count, double multiplier)
+{
+	const __m256d factor = _mm256_set1_pd(multiplier);
+	qsizetype i = 0;
+	for (; i + 4 <= count; i += 4) _mm256_storeu_pd(data + i, _mm256_mul_pd(_mm256_loadu_pd(data + i), factor));
+	scaleScalar(data + i, count - i, multiplier);
+}
+
+TARGET_AVX void negateAvx(double *data, qsizetype count)
+{
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	qsizetype i = 0;
+	for (; i + 4 <= count; i += 4) _mm256_storeu_pd(data + i, _mm256_xor_pd(_mm256_loadu_pd(data + i), sign));
+	negateScalar(data + i, count - i);
+}
+
+TARGET_AVX void limitsAvx(const double *data, qsizetype count, double &min, double &max)
+{
+	__m256d lower = _mm256_set1_pd(min);
+	__m256d upper = _mm256_set1_pd(max);
+	qsizetype i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m256d value = _mm256_loadu_pd(data + i);
+		lower = _mm256_min_pd(value, lower);
+		upper = _mm256_max_pd(value, upper);
+	}
+
+	double lowers[4], uppers[4];
+	_mm256_storeu_pd(lowers, lower);
+	_mm256_storeu_pd(uppers, upper);
+	for (int lane = 0; lane < 4; lane++) {
+		min = (lowers[lane] < min) ? lowers[lane] : min;
+		max = (uppers[lane] > max) ? uppers[lane] : max;
+	}
+	limitsScalar(data + i, count - i, min, max);
+}
+
+TARGET_AVX void averageAvx(const double *sums, qsizetype begin, qsizetype end, qsizetype window, double *result)
+{
+	const __m256d width = _mm256_set1_pd(static_cast<double>(window));
+	qsizetype i = begin;
+	for (; i + 4 <= end; i += 4) {
+		const __m256d sum = _mm256_sub_pd(_mm256_loadu_pd(sums + i + 1), _mm256_loadu_pd(sums + i + 1 - window));
+		_mm256_storeu_pd(result + i, _mm256_div_pd(sum, width));
+	}
+	averageScalar(sums, i, end, window, result);
+}
+
+TARGET_AVX void momentsAvx(const double *data, qsizetype count, double *sums, double *squares)
+{
+	__m256d sum = _mm256_loadu_pd(sums);
+	__m256d square = _mm256_loadu_pd(squares);
+	for (qsizetype i = 0; i + Lanes <= count; i += Lanes) {
+		const __m256d value = _mm256_loadu_pd(data + i);
+		sum = _mm256_add_pd(sum, value);
+		square = _mm256_add_pd(square, _mm256_mul_pd(value, value));
+	}
+	_mm256_storeu_pd(sums, sum);
+	_mm256_storeu_pd(squares, square);
+}
+
+const Implementation avx = {scaleAvx, negateAvx, limitsAvx, averageAvx, momentsAvx};
+
+Kernels::InstructionSet detectInstructionSet()
+{
+#if defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx")) return Kernels::InstructionSet::Avx;
+	if (__builtin_cpu_supports("sse2")) return Kernels::InstructionSet::Sse2;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	const bool sse2 = info[3] & (1 << 26);
+	const bool osxsave = info[2] & (1 << 27);
+	const bool supportsAvx = info[2] & (1 << 28);
+
+	// The system has to save the AVX registers too
+	if (osxsave && supportsAvx && ((_xgetbv(0) & 6) == 6)) return Kernels::InstructionSet::Avx;
+	if (sse2) return Kernels::InstructionSet::Sse2;
+#endif
+	return Kernels::InstructionSet::Scalar;
+}
+
+#else
+
+Kernels::InstructionSet detectInstructionSet()
+{
+	return Kernels::InstructionSet::Scalar;
+}
+
+#endif
+
+const Implementation *implementation(Kernels::InstructionSet set)
+{
+	switch (set) {
+#if defined(KERNELS_X86)
+	case Kernels::InstructionSet::Avx:  return &avx;
+	case Kernels::InstructionSet::Sse2: return &sse2;
+#endif
+	default: return &scalar;
+	}
+}
+
+Kernels::InstructionSet &current()
+{
+	static Kernels::InstructionSet set = Kernels::supportedInstructionSet();
+	return set;
+}
+
+}
+
+Kernels::InstructionSet Kernels::supportedInstructionSet()
+{
+	static const InstructionSet set = detectInstructionSet();
+	return set;
+}
+
+Kernels::InstructionSet Kernels::instructionSet()
+{
+	return current();
+}
+
+// Selects the instruction set, e.g. to compare the implementations
+bool Kernels::setInstructionSet(InstructionSet set)
+{
+	if (set > supportedInstructionSet()) return false;
+	current() = set;
+	return true;
+}
+
+const char *Kernels::instructionSetName(InstructionSet set)
+{
+	switch (set) {
+	case InstructionSet::Avx:  return "AVX";
+	case InstructionSet::Sse2: return "SSE2";
+	default:                   return "Scalar";
+	}
+}
+
+void Kernels::scale(double *data, qsizetype count, double multiplier)
+{
+	implementation(current())->scale(data, count, multiplier);
+}
+
+void Kernels::negate(double *data, qsizetype count)
+{
+	implementation(current())->negate(data, count);
+}
+
+bool Kernels::limits(const double *data, qsizetype count, double &min, double &max)
+{
+	min = qInf();
+	max = -qInf();
+	implementation(current())->limits(data, count, min, max);
+	return min <= max;
+}
+
+// Each sum depends on the previous one, so they are not vectorised
+void Kernels::prefixSums(const double *data, qsizetype count, double *sums)
+{
+	double sum = 0.0;
+	sums[0] = sum;
+	for (qsizetype i = 0; i < count; i++) {
+		sum += data[i];
+		sums[i + 1] = sum;
+	}
+}
+
+void Kernels::movingAverage(const double *sums, qsizetype count, qsizetype window, double *result)
+{
+	window = qBound<qsizetype>(1, window, qMax<qsizetype>(count, 1));
+	for (qsizetype i = 0; i < window && i < count; i++) {
+		result[i] = sums[i + 1] / static_cast<double>(i + 1);
+	}
+	implementation(current())->average(sums, window, count, window, result);
+}
+
+void Kernels::moments(const double *data, qsizetype count, double &sum, double &squares)
+{
+	double sums[Lanes] = {0.0, 0.0, 0.0, 0.0};
+	double squaresSums[Lanes] = {0.0, 0.0, 0.0, 0.0};
+	implementation(current())->moments(data, count, sums, squaresSums);
+
+	sum = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+	squares = (squaresSums[0] + squaresSums[1]) + (squaresSums[2] + squaresSums[3]);
+	for (qsizetype i = count - count % Lanes; i < count; i++) {
+		sum += data[i];
+		squares += data[i] * data[i];
+	}
+}
@@ -0,0 +1,54 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <QtGlobal>
+
+// Vectorised kernels for the samples. The implementation is chosen at runtime
+// from the instruction sets supported by the processor, the scalar one is used
+// on other processors. All implementations give identical results.
+namespace Kernels {
+
+enum class InstructionSet {Scalar, Sse2, Avx};
+
+InstructionSet supportedInstructionSet();
+InstructionSet instructionSet();
+bool setInstructionSet(InstructionSet set);
+const char *instructionSetName(InstructionSet set);
+
+// Multiplies the samples in place
+void scale(double *data, qsizetype count, double multiplier);
+
+// Inverts the sign of the samples in place
+void negate(double *data, qsizetype count);
+
+// Minimum and maximum of the samples, NaN samples are skipped.
+// Returns false if there are no samples except NaN.
+bool limits(const double *data, qsizetype count, double &min, double &max);
+
+// Sums of the samples before every index, count + 1 sums are written
+void prefixSums(const double *data, qsizetype count, double *sums);
+
+// Moving average of the samples given by their prefix sums, the first
+// samples are averaged over the shorter windows
+void movingAverage(const double *sums, qsizetype count, qsizetype window, double *result);
+
+// Sum of the samples and sum of their squares for the mean and RMS
+void moments(const double *data, qsizetype count, double &sum, double &squares);
+
+}
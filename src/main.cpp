@@ -89,7 +89,7 @@ int main(int argc, char *argv[])
 	w.show();
 	w.restoreSession();
 
-	foreach (auto filename, files) w.openFile(filename);
+	w.openFiles(files);
 
 	return a.exec();
 }
@@ -29,6 +29,9 @@
 #include <QMdiSubWindow>
 #include <QAction>
 #include <QLocalSocket>
+#include <QSharedPointer>
+#include <QThread>
+#include <QTimer>
 #include "doublelineedit.h"
 #include "mainwindow.h"
 #include "utils.h"
@@ -70,6 +73,17 @@ MainWindow::MainWindow(QWidget *parent)
 		} else {
 			mSignalsModel->setDataFile(nullptr);
 		}
+
+		// Restored windows are loaded on the first activation. The check is queued,
+		// so only the window left active after the session is restored is loaded.
+		if ((activeChartWindow != nullptr) && !activeChartWindow->pendingFile().isEmpty()) {
+			QPointer<ChartWindow> window = activeChartWindow;
+			QTimer::singleShot(0, this, [this, window]() {
+				if (window && (window == activeMdiChild()) && !window->pendingFile().isEmpty() && !mLoadingFiles.contains(window->pendingFile())) {
+					loadFile(window, window->pendingFile(), false);
+				}
+			});
+		}
 	});
 
 	connect(ui->actionOpen,           &QAction::triggered, this, &MainWindow::open);
@@ -148,8 +162,12 @@ void MainWindow::restoreSession()
 	restoreGeometry(settings.value("geometry").toByteArray());
 	restoreState(settings.value("state").toByteArray());
 
+	// Files are not loaded until their windows are activated
 	if (settings.value("Restore", true).toBool()) {
-		foreach (auto filename, filesFromSettings("OpenedFiles")) openFile(filename);
+		foreach (auto filename, filesFromSettings("OpenedFiles")) {
+			if (!isFileAlreadyOpen(filename)) addChartWindow(filename);
+		}
+		updateWindowMenu();
 	}
 }
 
@@ -162,12 +180,17 @@ void MainWindow::closeEvent(QCloseEvent *event)
 		foreach (auto *child, ui->mdiArea->subWindowList()) {
 			QPointer<ChartWindow> chart = qobject_cast<ChartWindow*>(child);
 			QPointer<DataFile> datafile = chart ? chart->dataFile() : nullptr;
-			if (datafile) files.append(datafile->fileName());
+			if (datafile) {
+				files.append(datafile->fileName());
+			} else if (chart && !chart->pendingFile().isEmpty()) {
+				files.append(chart->pendingFile());
+			}
 			if (chart) chart->close();
 		}
 	}
 
 	if (ui->mdiArea->currentSubWindow() == nullptr) {
+		stopWorkers();
 		saveSession();
 		event->accept();
 	} else {
@@ -191,14 +214,8 @@ void MainWindow::open()
 	).toString());
 
 	connect(dialog, &QFileDialog::accepted, this, [this, dialog]() {
-		bool ok = false;
-		foreach (auto filename, dialog->selectedFiles()) {
-			if (openFile(filename)) {
-				addToRecent(filename);
-				ok = true;
-			}
-		}
-		if (ok) QSettings().setValue("LastDir", dialog->directory().path());
+		if (openFiles(dialog->selectedFiles(), true))
+			QSettings().setValue("LastDir", dialog->directory().path());
 	});
 
 	dialog->open();
@@ -327,71 +344,165 @@ void MainWindow::updatePlotMenu()
 }
 
 bool MainWindow::openFile(const QString filename) {
-	if (isFileAlreadyOpen(filename)) return false;  //TODO: Add message
+	return openFiles(QStringList() << filename);
+}
 
-	DataFile *datafile = new DataFile(this);
+// Files are opened in parallel worker threads, every window is added at once
+// and shows its data file when it is loaded, so the order of windows is kept
+bool MainWindow::openFiles(const QStringList filenames, bool recent) {
+	bool started = false;
 
-	if (datafile->open(filename)) {
-		ChartWindow *newChartWindow = new ChartWindow(this);
-		newChartWindow->setDataFile(datafile);
-		ui->mdiArea->addSubWindow(newChartWindow);
-		newChartWindow->showMaximized();
-		newChartWindow->refresh();
-		updateWindowMenu();
-		return true;
+	foreach (auto filename, filenames) {
+		// Window of the opened file is activated, the restored one is loaded by the activation
+		auto *window = findChartWindow(filename);
+		if (window != nullptr) ui->mdiArea->setActiveSubWindow(window);
+
+		if (isFileAlreadyOpen(filename)) continue;  //TODO: Add message
+		loadFile(addChartWindow(filename), filename, recent);
+		started = true;
 	}
 
-	return false;
+	if (started) updateWindowMenu();
+	return started;
+}
+
+// Empty window of the file which is not loaded yet
+ChartWindow *MainWindow::addChartWindow(const QString filename) {
+	auto *newChartWindow = new ChartWindow(this);
+	newChartWindow->setPendingFile(filename);
+	ui->mdiArea->addSubWindow(newChartWindow);
+	newChartWindow->showMaximized();
+	return newChartWindow;
+}
+
+// The file is opened in the worker thread and shown in the window when done
+void MainWindow::loadFile(ChartWindow *window, const QString filename, bool recent) {
+	auto *datafile = new DataFile();
+	auto ok = QSharedPointer<bool>::create(false);
+	auto *thread = QThread::create([datafile, filename, ok]() {
+		*ok = datafile->open(filename);
+		datafile->moveToThread(QCoreApplication::instance()->thread());
+	});
+	datafile->moveToThread(thread);
+
+	QPointer<ChartWindow> newChartWindow = window;
+	connect(thread, &QThread::finished, this, [this, thread, datafile, ok, filename, recent, newChartWindow]() {
+		mWorkers.remove(thread);
+		mLoadingFiles.removeOne(filename);
+		thread->deleteLater();
+
+		if (*ok && newChartWindow) {
+			newChartWindow->setDataFile(datafile);
+			newChartWindow->refresh();
+			if (newChartWindow == activeMdiChild()) mSignalsModel->setDataFile(datafile);
+			if (recent) addToRecent(filename);
+			updateWindowMenu();
+		} else {
+			if (newChartWindow) newChartWindow->close();
+			delete datafile;
+		}
+	});
+
+	mWorkers.insert(thread, datafile);
+	mLoadingFiles.append(filename);
+	thread->start();
 }
 
 bool MainWindow::importReconTextFile(QString filename) {
+	auto *window = findChartWindow(filename);
+	if (window != nullptr) ui->mdiArea->setActiveSubWindow(window);
 	if (isFileAlreadyOpen(filename)) return false;  //TODO: Add message
 
-	auto *datafile = new ReconTextFile(this);
+	// The file is imported in the worker thread and returned to the GUI thread when done
+	auto *datafile = new ReconTextFile();
+	auto ok = QSharedPointer<bool>::create(false);
+	auto *thread = QThread::create([datafile, filename, ok]() {
+		*ok = datafile->importFile(filename);
+		datafile->moveToThread(QCoreApplication::instance()->thread());
+	});
+	datafile->moveToThread(thread);
+
+	auto *dialog = new QProgressDialog(this);
+	dialog->setAttribute(Qt::WA_DeleteOnClose, true);
+	dialog->setLabelText(tr("Importing %1").arg(filename));
+	dialog->setAutoClose(false);
+	dialog->setAutoReset(false);
+
+	connect(dialog, &QProgressDialog::canceled, datafile, &DataFile::cansel, Qt::DirectConnection);
+	connect(datafile, &DataFile::updateProgressRange, dialog, &QProgressDialog::setRange);
+	connect(datafile, &DataFile::updateProgressValue, dialog, &QProgressDialog::setValue);
+
+	// Show data while it is loading
+	QPointer<ChartWindow> newChartWindow = new ChartWindow(this);
+	newChartWindow->setWindowTitle(filename);
+	newChartWindow->setLoadingFile(datafile);
+	ui->mdiArea->addSubWindow(newChartWindow);
+	newChartWindow->showMaximized();
+	updateWindowMenu();
+
+	connect(datafile, &ReconTextFile::dataAppended, newChartWindow, &ChartWindow::appendData);
+	connect(newChartWindow, &QObject::destroyed, datafile, &DataFile::cansel, Qt::DirectConnection);
+
+	connect(thread, &QThread::finished, this, [this, thread, datafile, dialog, ok, filename, newChartWindow]() {
+		mWorkers.remove(thread);
+		mLoadingFiles.removeOne(filename);
+		thread->deleteLater();
+		dialog->close();
+
+		if (*ok && newChartWindow) {
+			disconnect(newChartWindow, &QObject::destroyed, datafile, &DataFile::cansel);
+			newChartWindow->setDataFile(datafile);
+			newChartWindow->refresh();
+			updateWindowMenu();
+		} else {
+			if (newChartWindow) newChartWindow->close();
+			delete datafile;
+		}
+	});
 
-	QProgressDialog dialog;
-	dialog.setLabelText(tr("Importing %1").arg(filename));
+	mWorkers.insert(thread, datafile);
+	mLoadingFiles.append(filename);
+	dialog->open();
+	thread->start();
 
-	connect(&dialog, &QProgressDialog::canceled, datafile, &DataFile::cansel);
-	connect(datafile, &DataFile::updateProgressRange, &dialog, &QProgressDialog::setRange);
-	connect(datafile, &DataFile::updateProgressValue, &dialog, &QProgressDialog::setValue);
-	dialog.open();
+	return true;
+}
 
-	if (datafile->importFile(filename)) {
-		ChartWindow *newChartWindow = new ChartWindow(this);
-		newChartWindow->setDataFile(datafile);
-		ui->mdiArea->addSubWindow(newChartWindow);
-		newChartWindow->showMaximized();
-		newChartWindow->refresh();
-		updateWindowMenu();
-		dialog.close();
-		return true;
+// Handlers of the finished workers are not called after this, so the workers are deleted here
+void MainWindow::stopWorkers() {
+	for (auto it = mWorkers.cbegin(); it != mWorkers.cend(); ++it) {
+		it.value()->cansel();
+		it.key()->wait();
+		disconnect(it.key(), nullptr, this, nullptr);
+		delete it.value();
+		delete it.key();
 	}
 
-	dialog.close();
-	return false;
+	mWorkers.clear();
+	mLoadingFiles.clear();
 }
 
 ChartWindow *MainWindow::activeMdiChild() const {
 	return qobject_cast<ChartWindow *>(ui->mdiArea->activeSubWindow());
 }
 
-bool MainWindow::isFileAlreadyOpen(const QString filename) {
+// Window of the file, whether it is loaded or not
+ChartWindow *MainWindow::findChartWindow(const QString filename) const {
 	foreach (auto *child, ui->mdiArea->subWindowList()) {
-		QPointer<ChartWindow> chartwindow = qobject_cast<ChartWindow*>(child);
+		auto *chartwindow = qobject_cast<ChartWindow*>(child);
 		if (chartwindow != nullptr) {
-			QPointer<DataFile> datafile = chartwindow->dataFile();
-			if (datafile) {
-				if (filename == datafile->fileName()) {
-					qDebug() << "File already opened:" << filename;
-					chartwindow->activateWindow();
-					return true;
-				}
-			}
+			if (filename == chartwindow->pendingFile()) return chartwindow;
+
+			auto *datafile = chartwindow->dataFile();
+			if ((datafile != nullptr) && (filename == datafile->fileName())) return chartwindow;
 		}
 	}
 
-	return false;
+	return nullptr;
+}
+
+bool MainWindow::isFileAlreadyOpen(const QString filename) const {
+	return mLoadingFiles.contains(filename) || (findChartWindow(filename) != nullptr);
 }
 
 QStringList MainWindow::filesFromSettings(QString option) {
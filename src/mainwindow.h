@@ -17,11 +17,13 @@
 #pragma once
 
 #include <QList>
+#include <QHash>
 #include <QCloseEvent>
 #include <QMainWindow>
 #include <QProgressBar>
 #include <QPrinter>
 #include <QLocalServer>
+#include <QThread>
 #include "datafile.h"
 #include "recontextfile.h"
 #include "chartwindow.h"
@@ -48,6 +50,7 @@ public:
 
 public slots:
 	bool openFile(const QString filename);
+	bool openFiles(const QStringList filenames, bool recent = false);
 
 private slots:
 	void closeEvent(QCloseEvent *event);
@@ -64,8 +67,14 @@ private:
 	SignalsModel *mSignalsModel;
 	QLocalServer *mServer;
     ColorDelegate *mColorDelegate;
+	QHash<QThread*, DataFile*> mWorkers;
+	QStringList mLoadingFiles;
 
 	ChartWindow *activeMdiChild() const;
-    bool isFileAlreadyOpen(const QString filename);
+	ChartWindow *addChartWindow(const QString filename);
+	void loadFile(ChartWindow *window, const QString filename, bool recent);
+	void stopWorkers();
+	ChartWindow *findChartWindow(const QString filename) const;
+    bool isFileAlreadyOpen(const QString filename) const;
     QStringList filesFromSettings(QString option);
 };
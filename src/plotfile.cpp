@@ -0,0 +1,551 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QDebug>
+#include <QByteArray>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include "plotfile.h"
+
+#define MAX_DECIMALS         9
+#define HEADER_SIZE          (sizeof(qint64) + sizeof(double))
+#define UNIFORM_HEADER_SIZE  (3 * sizeof(double) + sizeof(quint64))
+
+static const double powersOf10[MAX_DECIMALS + 1] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+QDataStream &operator<<(QDataStream &stream, const PlotBlock &block)
+{
+	const quint8 codec = static_cast<quint8>(block.codec) | static_cast<quint8>(static_cast<quint8>(block.encoding) << 4);
+	return stream << block.offset << block.size << block.count << codec;
+}
+
+QDataStream &operator>>(QDataStream &stream, PlotBlock &block)
+{
+	quint8 codec;
+	stream >> block.offset >> block.size >> block.count >> codec;
+	block.codec = static_cast<PlotCodec>(codec & 0x0F);
+	block.encoding = static_cast<PlotEncoding>(codec >> 4);
+	return stream;
+}
+
+static inline bool isShort(PlotEncoding type)
+{
+	return (type == PlotEncoding::Int16) || (type == PlotEncoding::DeltaInt16);
+}
+
+static inline bool isDelta(PlotEncoding type)
+{
+	return (type == PlotEncoding::DeltaInt32) || (type == PlotEncoding::DeltaInt16);
+}
+
+// Zeros are compared with the sign, as the codes can't keep the negative zero
+static inline bool isSame(double a, double b)
+{
+	return (a == b) && (std::signbit(a) == std::signbit(b));
+}
+
+// Converts the value to the decimal code, fails if the code doesn't restore the value exactly
+static inline bool toDecimal(double value, double divisor, qint64 &code)
+{
+	const double scaled = value * divisor;
+	if (!(qAbs(scaled) < 9007199254740992.0)) return false; // 2^53, NaN
+	code = qRound64(scaled);
+	return isSame(static_cast<double>(code) / divisor, value);
+}
+
+static inline bool isFloat(double value)
+{
+	return (qAbs(value) <= std::numeric_limits<float>::max()) && (static_cast<double>(static_cast<float>(value)) == value);
+}
+
+// Decimal codes, as is or as the difference with the previous one.
+// The difference wraps around, so it takes the same number of bits.
+template <typename T>
+static bool encodeDecimals(const double *data, qsizetype count, const SampleEncoding &encoding, char *out)
+{
+	typedef typename std::make_unsigned<T>::type U;
+	const bool delta = isDelta(encoding.type);
+	U previous = 0;
+
+	for (qsizetype i = 0; i < count; i++, out += sizeof(T)) {
+		qint64 code;
+		if (!toDecimal(data[i], encoding.divisor, code)) return false;
+		code -= encoding.base;
+		if (qAbs(code) > std::numeric_limits<T>::max()) return false;
+
+		const U value = static_cast<U>(code);
+		qToLittleEndian<U>(delta ? static_cast<U>(value - previous) : value, out);
+		previous = value;
+	}
+
+	return true;
+}
+
+template <typename T>
+static void decodeDecimals(const char *in, qsizetype count, const SampleEncoding &encoding, double *data)
+{
+	typedef typename std::make_unsigned<T>::type U;
+	const bool delta = isDelta(encoding.type);
+	U value = 0;
+
+	for (qsizetype i = 0; i < count; i++, in += sizeof(T)) {
+		const U stored = qFromLittleEndian<U>(in);
+		value = delta ? static_cast<U>(value + stored) : stored;
+		data[i] = static_cast<double>(encoding.base + static_cast<T>(value)) / encoding.divisor;
+	}
+}
+
+// Floating point samples, as is or XOR-ed with the previous one. Close
+// samples share the sign, the exponent and the high bits of the mantissa,
+// which become zero bytes.
+template <typename T, typename U>
+static bool encodeFloats(const double *data, qsizetype count, bool xored, char *out)
+{
+	U previous = 0;
+
+	for (qsizetype i = 0; i < count; i++, out += sizeof(U)) {
+		if (std::is_same<T, float>::value && !isFloat(data[i])) return false;
+
+		const T value = static_cast<T>(data[i]);
+		U bits;
+		memcpy(&bits, &value, sizeof(U));
+		qToLittleEndian<U>(xored ? bits ^ previous : bits, out);
+		previous = bits;
+	}
+
+	return true;
+}
+
+template <typename T, typename U>
+static void decodeFloats(const char *in, qsizetype count, bool xored, double *data)
+{
+	U bits = 0;
+
+	for (qsizetype i = 0; i < count; i++, in += sizeof(U)) {
+		const U stored = qFromLittleEndian<U>(in);
+		bits = xored ? bits ^ stored : stored;
+
+		T value;
+		memcpy(&value, &bits, sizeof(U));
+		data[i] = static_cast<double>(value);
+	}
+}
+
+// Converts the samples to the stored representation, fails if some of them
+// can't be restored exactly with the encoding. The first is the index of
+// the first sample in the column. Uniform samples are not checked if the
+// data is nullptr.
+static bool encodeSamples(const double *data, qsizetype count, quint64 first, const SampleEncoding &encoding, QByteArray &raw)
+{
+	if ((data == nullptr) && (encoding.type != PlotEncoding::Uniform)) return false;
+
+	switch (encoding.type) {
+	case PlotEncoding::Double:
+		raw.resize(static_cast<int>(count * sizeof(double)));
+		qToLittleEndian<double>(data, count, raw.data());
+		return true;
+
+	case PlotEncoding::XorDouble:
+		raw.resize(static_cast<int>(count * sizeof(double)));
+		return encodeFloats<double, quint64>(data, count, true, raw.data());
+
+	case PlotEncoding::Float32:
+	case PlotEncoding::XorFloat32:
+		raw.resize(static_cast<int>(count * sizeof(float)));
+		return encodeFloats<float, quint32>(data, count, encoding.type == PlotEncoding::XorFloat32, raw.data());
+
+	case PlotEncoding::Int32:
+	case PlotEncoding::Int16:
+	case PlotEncoding::DeltaInt32:
+	case PlotEncoding::DeltaInt16: {
+		const qsizetype size = isShort(encoding.type) ? sizeof(qint16) : sizeof(qint32);
+		raw.resize(static_cast<int>(HEADER_SIZE + count * size));
+		char *out = raw.data();
+		qToLittleEndian<qint64>(encoding.base, out);
+		qToLittleEndian<double>(encoding.divisor, out + sizeof(qint64));
+		out += HEADER_SIZE;
+
+		return isShort(encoding.type)
+			? encodeDecimals<qint16>(data, count, encoding, out)
+			: encodeDecimals<qint32>(data, count, encoding, out);
+	}
+
+	case PlotEncoding::Uniform: {
+		for (qsizetype i = 0; (data != nullptr) && (i < count); i++) {
+			if (encoding.uniformValue(first + static_cast<quint64>(i)) != data[i]) return false;
+		}
+
+		raw.resize(static_cast<int>(UNIFORM_HEADER_SIZE));
+		char *out = raw.data();
+		qToLittleEndian<double>(encoding.start, out);
+		qToLittleEndian<double>(encoding.step, out + sizeof(double));
+		qToLittleEndian<double>(encoding.divisor, out + 2 * sizeof(double));
+		qToLittleEndian<quint64>(first, out + 3 * sizeof(double));
+		return true;
+	}
+	}
+
+	return false;
+}
+
+static bool decodeSamples(const QByteArray &raw, const PlotBlock &block, double *data, SampleEncoding *encoding)
+{
+	const qsizetype count = static_cast<qsizetype>(block.count);
+	const quint64 size = static_cast<quint64>(raw.size());
+	const char *in = raw.constData();
+	SampleEncoding decoded;
+	decoded.type = block.encoding;
+
+	switch (block.encoding) {
+	case PlotEncoding::Double:
+		if (size != block.count * sizeof(double)) return false;
+		qFromLittleEndian<double>(in, count, data);
+		break;
+
+	case PlotEncoding::XorDouble:
+		if (size != block.count * sizeof(double)) return false;
+		decodeFloats<double, quint64>(in, count, true, data);
+		break;
+
+	case PlotEncoding::Float32:
+	case PlotEncoding::XorFloat32:
+		if (size != block.count * sizeof(float)) return false;
+		decodeFloats<float, quint32>(in, count, block.encoding == PlotEncoding::XorFloat32, data);
+		break;
+
+	case PlotEncoding::Int32:
+	case PlotEncoding::Int16:
+	case PlotEncoding::DeltaInt32:
+	case PlotEncoding::DeltaInt16:
+		if (size != HEADER_SIZE + block.count * (isShort(block.encoding) ? sizeof(qint16) : sizeof(qint32))) return false;
+
+		decoded.base = qFromLittleEndian<qint64>(in);
+		decoded.divisor = qFromLittleEndian<double>(in + sizeof(qint64));
+		in += HEADER_SIZE;
+
+		if (isShort(block.encoding)) {
+			decodeDecimals<qint16>(in, count, decoded, data);
+		} else {
+			decodeDecimals<qint32>(in, count, decoded, data);
+		}
+		break;
+
+	case PlotEncoding::Uniform: {
+		if (size != UNIFORM_HEADER_SIZE) return false;
+
+		decoded.start = qFromLittleEndian<double>(in);
+		decoded.step = qFromLittleEndian<double>(in + sizeof(double));
+		decoded.divisor = qFromLittleEndian<double>(in + 2 * sizeof(double));
+		const quint64 first = qFromLittleEndian<quint64>(in + 3 * sizeof(double));
+
+		for (qsizetype i = 0; i < count; i++)
+			data[i] = decoded.uniformValue(first + static_cast<quint64>(i));
+		break;
+	}
+
+	default:
+		qDebug() << "Unknown block encoding:" << static_cast<int>(block.encoding);
+		return false;
+	}
+
+	if (encoding != nullptr) *encoding = decoded;
+	return true;
+}
+
+quint64 samplesCount(const PlotBlockList &blocks)
+{
+	quint64 count = 0;
+	for (const auto &block : blocks) count += block.count;
+	return count;
+}
+
+qsizetype blocksCount(qsizetype count)
+{
+	return (count + PLOT_BLOCK_SIZE - 1) / PLOT_BLOCK_SIZE;
+}
+
+// Looks for the step which gives all samples, rounded to the divisor if it is not zero.
+// Every rounded sample limits the range of the steps, the middle of the range is used.
+static bool findUniform(const double *data, qsizetype count, double divisor, SampleEncoding &encoding)
+{
+	if (count < 2) return false;
+
+	SampleEncoding uniform;
+	uniform.type = PlotEncoding::Uniform;
+	uniform.start = data[0];
+	uniform.divisor = divisor;
+
+	if (divisor > 0.0) {
+		double low = -std::numeric_limits<double>::infinity();
+		double high = std::numeric_limits<double>::infinity();
+
+		for (qsizetype i = 1; i < count; i++) {
+			const double code = std::round(data[i] * divisor);
+			low = qMax(low, ((code - 0.5) / divisor - data[0]) / static_cast<double>(i));
+			high = qMin(high, ((code + 0.5) / divisor - data[0]) / static_cast<double>(i));
+			if (!(low < high)) return false;
+		}
+
+		uniform.step = (low + high) / 2;
+	} else {
+		uniform.step = (data[count - 1] - data[0]) / static_cast<double>(count - 1);
+	}
+
+	if (!(uniform.step > 0.0) || !qIsFinite(uniform.step)) return false;
+
+	for (qsizetype i = 0; i < count; i++) {
+		if (!isSame(uniform.uniformValue(static_cast<quint64>(i)), data[i])) return false;
+	}
+
+	encoding = uniform;
+	return true;
+}
+
+// Looks for the most compact encoding which restores all samples exactly
+SampleEncoding chooseEncoding(const double *data, qsizetype count)
+{
+	SampleEncoding encoding;
+	if (count == 0) return encoding;
+
+	// Time axis calculated with the step
+	if (findUniform(data, count, 0.0, encoding)) return encoding;
+
+	for (int decimals = 0; decimals <= MAX_DECIMALS; decimals++) {
+		const double divisor = powersOf10[decimals];
+		qint64 code, previous, min, max;
+		double deltas = 0.0;
+
+		if (!toDecimal(data[0], divisor, code)) continue;
+		min = max = previous = code;
+
+		qsizetype i = 1;
+		for (; i < count; i++) {
+			if (!toDecimal(data[i], divisor, code)) break;
+			min = qMin(min, code);
+			max = qMax(max, code);
+			deltas += static_cast<double>(qAbs(code - previous));
+			previous = code;
+		}
+		if (i < count) continue;
+
+		// More decimals make the range only wider
+		const quint64 range = static_cast<quint64>(max - min);
+		if (range > 0xFFFFFFFEull) break;
+
+		// Time axis exported with the fixed number of decimals
+		if (findUniform(data, count, divisor, encoding)) return encoding;
+
+		// Differences of smooth signals are smaller than the codes,
+		// codes of the spread ones are about a quarter of the range
+		const bool delta = deltas < static_cast<double>(range) * static_cast<double>(count) / 4;
+		if (range <= 0xFFFEull) {
+			encoding.type = delta ? PlotEncoding::DeltaInt16 : PlotEncoding::Int16;
+		} else {
+			encoding.type = delta ? PlotEncoding::DeltaInt32 : PlotEncoding::Int32;
+		}
+		encoding.base = min + static_cast<qint64>(range / 2);
+		encoding.divisor = divisor;
+		return encoding;
+	}
+
+	for (qsizetype i = 0; i < count; i++) {
+		if (!isFloat(data[i])) {
+			encoding.type = PlotEncoding::XorDouble;
+			return encoding;
+		}
+	}
+
+	encoding.type = PlotEncoding::XorFloat32;
+	return encoding;
+}
+
+// Every block is encoded and compressed on its own, so the memory used doesn't depend on the count of samples
+bool writeBlocks(QIODevice &device, const double *data, qsizetype count, PlotBlockList &blocks, PlotCodec codec, const SampleEncoding &encoding, const PlotProgress &progress)
+{
+	QByteArray raw;
+	blocks.clear();
+
+	// Align raw samples
+	if ((codec == PlotCodec::Raw) && (encoding.type == PlotEncoding::Double) && (device.pos() % sizeof(double))) {
+		const QByteArray padding(static_cast<int>(sizeof(double) - device.pos() % sizeof(double)), '\0');
+		if (device.write(padding) != padding.size()) return false;
+	}
+
+	for (qsizetype first = 0; first < count; first += PLOT_BLOCK_SIZE) {
+		const qsizetype size = qMin<qsizetype>(PLOT_BLOCK_SIZE, count - first);
+
+		// Samples which don't fit the encoding are stored as doubles,
+		// uniform samples may be given by the encoding only
+		PlotEncoding type = encoding.type;
+		if (data == nullptr) {
+			if (!encodeSamples(nullptr, size, static_cast<quint64>(first), encoding, raw)) return false;
+		} else if (!encodeSamples(data + first, size, static_cast<quint64>(first), encoding, raw)) {
+			type = PlotEncoding::Double;
+			encodeSamples(data + first, size, 0, SampleEncoding(), raw);
+		}
+		const QByteArray stored = (codec == PlotCodec::Zlib) ? qCompress(raw) : raw;
+
+		PlotBlock block;
+		block.offset = static_cast<quint64>(device.pos());
+		block.size = static_cast<quint64>(stored.size());
+		block.count = static_cast<quint64>(size);
+		block.codec = codec;
+		block.encoding = type;
+
+		if (device.write(stored) != stored.size()) {
+			qDebug() << "Unable to write block:" << device.errorString();
+			return false;
+		}
+
+		blocks.append(block);
+		if (progress && !progress()) return false;
+	}
+
+	return true;
+}
+
+static bool readPayload(QIODevice &device, const PlotBlock &block, QByteArray &raw)
+{
+	if (!device.seek(static_cast<qint64>(block.offset))) return false;
+
+	const QByteArray stored = device.read(static_cast<qint64>(block.size));
+	if (static_cast<quint64>(stored.size()) != block.size) return false;
+
+	switch (block.codec) {
+	case PlotCodec::Raw:  raw = stored; return true;
+	case PlotCodec::Zlib: raw = qUncompress(stored); return true;
+	}
+
+	qDebug() << "Unknown block codec:" << static_cast<int>(block.codec);
+	return false;
+}
+
+bool readBlock(QIODevice &device, const PlotBlock &block, double *data, SampleEncoding *encoding)
+{
+	QByteArray raw;
+	return readPayload(device, block, raw) && decodeSamples(raw, block, data, encoding);
+}
+
+// Reads the encoding of the column if all its blocks are parts of the same uniform axis
+bool readUniform(QIODevice &device, const PlotBlockList &blocks, SampleEncoding &encoding)
+{
+	quint64 first = 0;
+
+	for (const auto &block : blocks) {
+		QByteArray raw;
+		if ((block.encoding != PlotEncoding::Uniform) || !readPayload(device, block, raw)) return false;
+		if (static_cast<quint64>(raw.size()) != UNIFORM_HEADER_SIZE) return false;
+
+		const char *in = raw.constData();
+		SampleEncoding uniform;
+		uniform.type = PlotEncoding::Uniform;
+		uniform.start = qFromLittleEndian<double>(in);
+		uniform.step = qFromLittleEndian<double>(in + sizeof(double));
+		uniform.divisor = qFromLittleEndian<double>(in + 2 * sizeof(double));
+
+		if (qFromLittleEndian<quint64>(in + 3 * sizeof(double)) != first) return false;
+		if ((first != 0) && ((uniform.start != encoding.start) || (uniform.step != encoding.step) || (uniform.divisor != encoding.divisor)))
+			return false;
+
+		encoding = uniform;
+		first += block.count;
+	}
+
+	return !blocks.isEmpty();
+}
+
+// Reports the encoding of the first block
+bool readBlocks(QIODevice &device, const PlotBlockList &blocks, QVector<double> &data, SampleEncoding *encoding)
+{
+	data.resize(static_cast<qsizetype>(samplesCount(blocks)));
+
+	double *out = data.data();
+	for (const auto &block : blocks) {
+		if (!readBlock(device, block, out, (out == data.data()) ? encoding : nullptr)) {
+			data.clear();
+			return false;
+		}
+		out += block.count;
+	}
+
+	return true;
+}
+
+// The file is kept open and mapped only if it has raw blocks to be mapped,
+// otherwise it is opened only while the blocks are read.
+PlotFileReader::PlotFileReader(const QString filename, bool mapped)
+	: mFile(filename)
+	, mMemory(nullptr)
+	, mReplaced(false)
+{
+	if (!mapped) return;
+
+	if (mFile.open(QIODevice::ReadOnly)) {
+		mMemory = mFile.map(0, mFile.size());
+		if (mMemory == nullptr) mFile.close();
+	} else {
+		qDebug() << "Unable to open: " << filename;
+	}
+}
+
+// Returns the pointer to the samples stored in the mapped memory or nullptr
+// if the blocks are compressed, encoded or are not stored one after another.
+const double *PlotFileReader::map(const PlotBlockList &blocks) const
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+	if ((mMemory == nullptr) || blocks.isEmpty()) return nullptr;
+
+	quint64 offset = blocks.first().offset;
+	if (offset % sizeof(double)) return nullptr;
+
+	for (const auto &block : blocks) {
+		if ((block.codec != PlotCodec::Raw) || (block.encoding != PlotEncoding::Double) ||
+			(block.offset != offset) || (block.size != block.count * sizeof(double)))
+			return nullptr;
+		offset += block.size;
+	}
+
+	if (offset > static_cast<quint64>(mFile.size())) return nullptr;
+	return reinterpret_cast<const double*>(mMemory + blocks.first().offset);
+#else
+	Q_UNUSED(blocks)
+	return nullptr;
+#endif
+}
+
+bool PlotFileReader::read(const PlotBlockList &blocks, QVector<double> &data, SampleEncoding *encoding)
+{
+	QMutexLocker locker(&mMutex);
+	if (isMapped()) return readBlocks(mFile, blocks, data, encoding);
+
+	// The blocks are not in the file which replaced this one
+	if (mReplaced) {
+		qDebug() << "Replaced: " << mFile.fileName();
+		return false;
+	}
+
+	if (!mFile.open(QIODevice::ReadOnly)) {
+		qDebug() << "Unable to open: " << mFile.fileName();
+		return false;
+	}
+
+	const bool result = readBlocks(mFile, blocks, data, encoding);
+	mFile.close();
+	return result;
+}
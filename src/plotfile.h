@@ -0,0 +1,138 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <QVector>
+#include <QFile>
+#include <QIODevice>
+#include <QDataStream>
+#include <QSharedPointer>
+#include <QMutex>
+#include <functional>
+
+// Plot file version 2 layout:
+//
+//   header     MAGIC, VERSION, directory offset (quint64)
+//   blocks     samples of the time axis and of every channel, split into
+//              blocks of PLOT_BLOCK_SIZE values, each one stored independently
+//   directory  document properties, the time axis and the channels
+//              description with the list of blocks of each of them,
+//              followed by the optional sections (statistics, pyramids)
+//
+// When only the metadata is changed, the new directory is appended to the
+// file and the header is pointed to it once the directory is on the disk,
+// the blocks are kept as they are. The previous directories are dropped
+// when the file is saved entirely, which is done when they take too much.
+//
+// Header and directory are written by QDataStream (Qt_5_0, big endian),
+// samples in the blocks are little endian. Every block may store samples
+// in a compact encoding (see SampleEncoding) and be compressed. Raw blocks
+// are aligned to 8 bytes, so uncompressed doubles may be used straight from
+// the memory mapped file.
+
+#define PLOT_BLOCK_SIZE  65536
+
+// Low nibble of the block codec byte
+enum class PlotCodec : quint8 {
+	Raw  = 0,   // As is
+	Zlib = 1,   // qCompress()
+};
+
+// High nibble of the block codec byte
+enum class PlotEncoding : quint8 {
+	Double     = 0,   // Doubles
+	Float32    = 1,   // Floats
+	Int32      = 2,   // Header (qint64 base, double divisor), 32 bit codes
+	Int16      = 3,   // Header (qint64 base, double divisor), 16 bit codes
+	XorDouble  = 4,   // Doubles XOR-ed with the previous one
+	XorFloat32 = 5,   // Floats XOR-ed with the previous one
+	DeltaInt32 = 6,   // As Int32, differences of the codes
+	DeltaInt16 = 7,   // As Int16, differences of the codes
+	Uniform    = 8,   // Header (double start, step, divisor, quint64 first index), no samples
+};
+
+// Decimal samples are stored as (base + code) / divisor, where the divisor
+// is a power of ten. Exported RECON values have a fixed number of decimals,
+// so their decimal digits fit in 16 or 32 bits and are restored exactly.
+// The negative zero has no code, such samples are stored as floats.
+// Uniform samples are start + index * step, rounded to the divisor if it
+// is not zero, so the time axis takes no space at all.
+struct SampleEncoding
+{
+	PlotEncoding type = PlotEncoding::Double;
+	qint64 base = 0;
+	double divisor = 1.0;
+	double start = 0.0;
+	double step = 0.0;
+
+	double uniformValue(quint64 index) const {
+		const double value = start + static_cast<double>(index) * step;
+		return (divisor > 0.0) ? static_cast<double>(qRound64(value * divisor)) / divisor : value;
+	}
+};
+
+struct PlotBlock
+{
+	quint64 offset = 0;                 // Position in the file
+	quint64 size = 0;                   // Stored size in bytes
+	quint64 count = 0;                  // Number of samples
+	PlotCodec codec = PlotCodec::Zlib;
+	PlotEncoding encoding = PlotEncoding::Double;
+};
+
+typedef QVector<PlotBlock> PlotBlockList;
+
+QDataStream &operator<<(QDataStream &stream, const PlotBlock &block);
+QDataStream &operator>>(QDataStream &stream, PlotBlock &block);
+
+// Called after every block is written, the writing is stopped if it returns false
+typedef std::function<bool()> PlotProgress;
+
+quint64 samplesCount(const PlotBlockList &blocks);
+qsizetype blocksCount(qsizetype count);
+SampleEncoding chooseEncoding(const double *data, qsizetype count);
+bool writeBlocks(QIODevice &device, const double *data, qsizetype count, PlotBlockList &blocks, PlotCodec codec = PlotCodec::Zlib, const SampleEncoding &encoding = SampleEncoding(), const PlotProgress &progress = PlotProgress());
+bool readBlock(QIODevice &device, const PlotBlock &block, double *data, SampleEncoding *encoding = nullptr);
+bool readBlocks(QIODevice &device, const PlotBlockList &blocks, QVector<double> &data, SampleEncoding *encoding = nullptr);
+bool readUniform(QIODevice &device, const PlotBlockList &blocks, SampleEncoding &encoding);
+
+// Plot file opened for reading samples, mapped into memory when it is possible.
+// Samples may be read from several threads.
+class PlotFileReader
+{
+public:
+	explicit PlotFileReader(const QString filename, bool mapped = true);
+
+	QString fileName() const {return mFile.fileName();}
+	bool isMapped()    const {return mMemory != nullptr;}
+
+	const double *map(const PlotBlockList &blocks) const;
+	bool read(const PlotBlockList &blocks, QVector<double> &data, SampleEncoding *encoding = nullptr);
+
+	// The file is not read while it is replaced, the replaced file is not read at all
+	void lock()        {mMutex.lock();}
+	void unlock()      {mMutex.unlock();}
+	void setReplaced() {mReplaced = true;}
+
+private:
+	QFile mFile;
+	uchar *mMemory;
+	QMutex mMutex;
+	bool mReplaced;
+};
+
+typedef QSharedPointer<PlotFileReader> PlotFileReaderPtr;
@@ -0,0 +1,155 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <QtMath>
+#include "kernels.h"
+#include "pyramid.h"
+
+namespace {
+
+// Expands the limits by the items from begin to end, NaN items are skipped
+void scan(const double *min, const double *max, qsizetype begin, qsizetype end, double &lower, double &upper, bool &found)
+{
+	for (qsizetype i = begin; i < end; i++) {
+		if (qIsNaN(min[i])) continue;
+		if (!found) {
+			lower = min[i];
+			upper = max[i];
+			found = true;
+		} else {
+			if (min[i] < lower) lower = min[i];
+			if (max[i] > upper) upper = max[i];
+		}
+	}
+}
+
+// Limits of the blocks of Factor items
+void reduce(const double *min, const double *max, qsizetype blocks, double *lower, double *upper)
+{
+	// Blocks of the samples are reduced by the vectorised kernel
+	if (min == max) {
+		for (qsizetype i = 0; i < blocks; i++) {
+			if (!Kernels::limits(min + i * Pyramid::Factor, Pyramid::Factor, lower[i], upper[i])) {
+				lower[i] = upper[i] = qQNaN();
+			}
+		}
+		return;
+	}
+
+	for (qsizetype i = 0; i < blocks; i++) {
+		bool found = false;
+		lower[i] = qQNaN();
+		upper[i] = qQNaN();
+		scan(min, max, i * Pyramid::Factor, (i + 1) * Pyramid::Factor, lower[i], upper[i], found);
+	}
+}
+
+}
+
+// Offsets of the levels for the count of samples, the last item is the size of all levels
+QVector<qsizetype> Pyramid::levels(qsizetype count)
+{
+	QVector<qsizetype> result = {0};
+	for (count /= Factor; count > 0; count /= Factor) {
+		result.append(result.last() + count);
+	}
+	return result;
+}
+
+void Pyramid::build(const double *data, qsizetype count)
+{
+	clear();
+	mCount = count;
+	mLevels = levels(count);
+
+	QVector<double> min(mLevels.last());
+	QVector<double> max(mLevels.last());
+
+	const double *lower = data;
+	const double *upper = data;
+	for (qsizetype level = 0; level < mLevels.count() - 1; level++) {
+		const qsizetype offset = mLevels.at(level);
+		reduce(lower, upper, mLevels.at(level + 1) - offset, min.data() + offset, max.data() + offset);
+		lower = min.constData() + offset;
+		upper = max.constData() + offset;
+	}
+
+	mMin = Samples(min);
+	mMax = Samples(max);
+}
+
+// Uses the levels read from the plot file
+bool Pyramid::setLevels(qsizetype count, const Samples &min, const Samples &max)
+{
+	clear();
+
+	const auto offsets = levels(count);
+	if ((min.count() != offsets.last()) || (max.count() != offsets.last())) return false;
+
+	mCount = count;
+	mLevels = offsets;
+	mMin = min;
+	mMax = max;
+	return true;
+}
+
+// Samples at the ends of the range, which don't fill a whole block, are
+// scanned on the level below. Returns false if all samples are NaN.
+bool Pyramid::limits(const double *data, qsizetype begin, qsizetype end, double &min, double &max) const
+{
+	bool found = false;
+	min = qQNaN();
+	max = qQNaN();
+
+	const double *lower = data;
+	const double *upper = data;
+	for (qsizetype level = 0; level < mLevels.count(); level++) {
+		if (level < mLevels.count() - 1) {
+			const qsizetype first = (begin + Factor - 1) / Factor;
+			const qsizetype last = end / Factor;
+			if (first < last) {
+				scan(lower, upper, begin, first * Factor, min, max, found);
+				scan(lower, upper, last * Factor, end, min, max, found);
+				begin = first;
+				end = last;
+				lower = mMin.constData() + mLevels.at(level);
+				upper = mMax.constData() + mLevels.at(level);
+				continue;
+			}
+		}
+
+		scan(lower, upper, begin, end, min, max, found);
+		break;
+	}
+
+	return found;
+}
+
+// Makes the pyramid independent from the file it is mapped from
+void Pyramid::detach()
+{
+	mMin.vector();
+	mMax.vector();
+}
+
+void Pyramid::clear()
+{
+	mMin.clear();
+	mMax.clear();
+	mLevels.clear();
+	mCount = 0;
+}
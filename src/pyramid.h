@@ -0,0 +1,51 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <QVector>
+#include "samples.h"
+
+// Multi-resolution minimums and maximums of the samples. Every level keeps the
+// limits of the blocks of Factor items of the level below, so the limits of any
+// range of samples are found by scanning O(Factor * log(count)) items.
+// NaN samples are skipped, the block of NaN samples has NaN limits.
+// Levels are kept one after another, they may be mapped from the plot file.
+class Pyramid
+{
+public:
+	static constexpr qsizetype Factor = 32;
+
+	qsizetype count()           const {return mCount;}
+	bool isEmpty()              const {return mCount == 0;}
+	const Samples &minimums()   const {return mMin;}
+	const Samples &maximums()   const {return mMax;}
+
+	void build(const double *data, qsizetype count);
+	bool setLevels(qsizetype count, const Samples &min, const Samples &max);
+	bool limits(const double *data, qsizetype begin, qsizetype end, double &min, double &max) const;
+	void detach();
+	void clear();
+
+	static QVector<qsizetype> levels(qsizetype count);
+
+private:
+	Samples mMin;
+	Samples mMax;
+	QVector<qsizetype> mLevels;     // Offset of every level and the size of all levels at the end
+	qsizetype mCount = 0;           // Count of the samples
+};
@@ -14,20 +14,30 @@
 //    You should have received a copy of the GNU General Public License
 //    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <QDebug>
-#include <QElapsedTimer>
 #include <QSharedPointer>
-#include <QCoreApplication>
+#include <QVarLengthArray>
+#include <QThread>
+#include <QtConcurrent>
 #include "utils.h"
 #include "recontextfile.h"
 
+// The data section smaller than this is parsed in the calling thread
+#define MIN_CHUNK_SIZE  (1 << 20)
+
 ReconTextFile::ReconTextFile(QObject *parent)
 	: DataFile(parent)
-{}
+{
+	qRegisterMetaType<QVector<double>>("QVector<double>");
+	qRegisterMetaType<QVector<QVector<double>>>("QVector<QVector<double>>");
+}
 
 bool ReconTextFile::importFile(QString filename)
 {
-	mCansel = false;
+	mCansel.storeRelaxed(0);
 
 	// Clear data
 	foreach (auto item, mAnalogSignals) if (item != nullptr) delete item;
@@ -45,7 +55,6 @@ bool ReconTextFile::importFile(QString filename)
 		emit updateProgressRange(0, datafile.size());
 		emit updateProgressShow(true);
 		emit updateProgressValue(0);
-		qApp->processEvents();
 
 		// Read header
 		QString line = QString::fromLocal8Bit(datafile.readLine());
@@ -101,44 +110,86 @@ bool ReconTextFile::importFile(QString filename)
 		datafile.readLine();
 		datafile.readLine();
 
+		// Map the data section into memory, read it if mapping is not supported
+		const qint64 offset = datafile.pos();
+		const qint64 size = datafile.size() - offset;
+		QByteArray buffer;
+		const char *begin = nullptr;
+		const char *end = nullptr;
+
+		uchar *memory = (size > 0) ? datafile.map(offset, size) : nullptr;
+		if (memory != nullptr) {
+			begin = reinterpret_cast<const char*>(memory);
+			end = begin + size;
+		} else {
+			buffer = datafile.readAll();
+			begin = buffer.constData();
+			end = begin + buffer.size();
+		}
+
 		// Update progress
-		emit updateProgressValue(static_cast<int>(datafile.pos()));
-		qApp->processEvents();
-		QElapsedTimer timer;
-		timer.start();
+		emit updateProgressValue(static_cast<int>(offset));
 
-		// Read data
-		for (;;) {
-			// Cansel
-			if (mCansel) break;
+		// Split data into newline aligned chunks
+		const qint64 chunkCount = qBound<qint64>(1, (end - begin) / MIN_CHUNK_SIZE, QThread::idealThreadCount() * 8);
+		QVector<ReconTextChunk> chunks(static_cast<int>(chunkCount));
+		const char *chunkBegin = begin;
+		for (int i = 0; i < chunks.count(); i++) {
+			const char *chunkEnd = (i + 1 < chunks.count()) ? begin + (end - begin) * (i + 1) / chunks.count() : end;
+			if (chunkEnd < chunkBegin) chunkEnd = chunkBegin;
+			const char *eol = static_cast<const char*>(memchr(chunkEnd, '\n', end - chunkEnd));
+			chunkEnd = (eol != nullptr) ? eol + 1 : end;
 
-			line = QString::fromLocal8Bit(datafile.readLine()).simplified();
-			QStringList values = line.split(',');
-			if (values.count() != (mAnalogSignals.count() + 3)) break;  //TODO: Fix for discrete signals
-
-			// Get units
-			if (values[0].simplified().isEmpty())
-				for (int i = 0; i < mAnalogSignals.count(); i++)
-					mAnalogSignals[i]->setUnit(values[i+2].simplified());
-
-			// Get data
-			else if (values.count() >= 3) {
-				mTime.append(str2qreal(values[1].simplified()));
-				for (int i = 0; i < mAnalogSignals.count(); i++)
-					mAnalogSignals[i]->data()->append(str2qreal(values[i+2].simplified()));
+			chunks[i].begin = chunkBegin;
+			chunks[i].end = chunkEnd;
+			chunks[i].columns.resize(mAnalogSignals.count() + 1);
+			chunkBegin = chunkEnd;
+		}
+
+		// Reserve memory using the average length of the first rows
+		const qint64 window = qMin<qint64>(end - begin, 65536);
+		const qint64 lines = std::count(begin, begin + window, '\n');
+		if (lines > 0) {
+			const qsizetype rows = static_cast<qsizetype>((end - begin) * lines / window + 1);
+			mTime.samples().vector().reserve(rows);
+			foreach (auto *signal, mAnalogSignals) signal->mutableData()->reserve(rows);
+		}
+
+		// Parse chunks and join them in order as soon as they are ready,
+		// up to the first row which does not match
+		QAtomicInteger<qint64> parsed(0);
+		if (chunks.count() == 1) {
+			readDataChunk(chunks.first(), parsed);
+			joinDataChunk(chunks.first());
+		} else {
+			// Chunks which are not started yet are skipped after the stop
+			QAtomicInt skipped(0);
+			QVector<QFuture<void>> futures;
+			futures.reserve(chunks.count());
+			for (auto &chunk : chunks) {
+				futures.append(QtConcurrent::run([this, &chunk, &parsed, &skipped]() {
+					if (!skipped.loadAcquire()) readDataChunk(chunk, parsed);
+				}));
 			}
 
-			// Update progress avery 1000 milliseconds
-			if (timer.hasExpired(100)) {
-				emit updateProgressValue(datafile.pos());
-				qApp->processEvents();
-				timer.restart();
+			bool stopped = false;
+			for (int i = 0; i < chunks.count(); i++) {
+				futures[i].waitForFinished();
+				if (stopped) continue;
+
+				joinDataChunk(chunks.at(i));
+				stopped = chunks.at(i).stopped;
+				if (stopped) skipped.storeRelease(1);
+				emit updateProgressValue(static_cast<int>(offset + parsed.loadRelaxed()));
 			}
 		}
 
-		if (!mCansel) {
+		if (memory != nullptr) datafile.unmap(memory);
+
+		if (!mCansel.loadRelaxed()) {
 			datafile.close();
 
+			chooseEncoding();
 			calculateLimits();
 			resetWindow();
 
@@ -154,6 +205,101 @@ bool ReconTextFile::importFile(QString filename)
 	return false;
 }
 
+void ReconTextFile::readDataChunk(ReconTextChunk &chunk, QAtomicInteger<qint64> &progress)
+{
+	// Reserve memory using the average length of the first rows
+	const qint64 window = qMin<qint64>(chunk.end - chunk.begin, 65536);
+	const qint64 lines = std::count(chunk.begin, chunk.begin + window, '\n');
+	if (lines > 0) {
+		const qsizetype rows = static_cast<qsizetype>((chunk.end - chunk.begin) * lines / window + 1);
+		for (auto &column : chunk.columns) column.reserve(rows);
+	}
+
+	QVarLengthArray<const char*, 64> fields;
+	const char *reported = chunk.begin;
+	const char *eol = nullptr;
+	quint32 row = 0;
+
+	for (const char *line = chunk.begin; line < chunk.end; line = eol + 1) {
+		// Cansel
+		if (mCansel.loadRelaxed()) {
+			chunk.stopped = true;
+			break;
+		}
+
+		eol = static_cast<const char*>(memchr(line, '\n', chunk.end - line));
+		if (eol == nullptr) eol = chunk.end;
+
+		if (!readDataRow(line, eol, fields, chunk)) {
+			chunk.stopped = true;
+			break;
+		}
+
+		if ((++row % 4096) == 0) {
+			progress.fetchAndAddRelaxed(eol - reported);
+			reported = eol;
+		}
+	}
+
+	progress.fetchAndAddRelaxed(chunk.end - reported);
+}
+
+// Called by the loading thread only, the GUI gets the legend names with the data
+void ReconTextFile::joinDataChunk(const ReconTextChunk &chunk)
+{
+	foreach (const auto &units, chunk.units)
+		for (int i = 0; i < mAnalogSignals.count(); i++)
+			mAnalogSignals[i]->setUnit(units.at(i));
+
+	if (chunk.columns.first().isEmpty()) return;
+
+	mTime.samples().vector().append(chunk.columns.first());
+	for (int i = 0; i < mAnalogSignals.count(); i++)
+		mAnalogSignals[i]->mutableData()->append(chunk.columns.at(i + 1));
+
+	QStringList names;
+	foreach (auto *signal, mAnalogSignals) names.append(signal->name(true));
+
+	emit dataAppended(chunk.columns.first(), chunk.columns.mid(1), names);
+}
+
+bool ReconTextFile::readDataRow(const char *begin, const char *end, QVarLengthArray<const char*, 64> &fields, ReconTextChunk &chunk)
+{
+	const int channels = chunk.columns.count() - 1;
+	const int columns = channels + 3;  //TODO: Fix for discrete signals
+
+	// Split by comma, fields[i] points to the value i (fields[i+1] - 1 is its end)
+	fields.resize(0);
+	fields.append(begin);
+	for (const char *p = static_cast<const char*>(memchr(begin, ',', end - begin)); p != nullptr;
+		 p = static_cast<const char*>(memchr(p + 1, ',', end - p - 1))) {
+		if (fields.count() == columns) return false;
+		fields.append(p + 1);
+	}
+	if (fields.count() != columns) return false;
+
+	auto fieldEnd = [&fields, columns, end](int i) {
+		return (i + 1 < columns) ? fields[i+1] - 1 : end;
+	};
+
+	// Get units
+	const char *first = fields[0];
+	while ((first < fieldEnd(0)) && isspace(static_cast<unsigned char>(*first))) first++;
+	if (first == fieldEnd(0)) {
+		QStringList units;
+		for (int i = 0; i < channels; i++)
+			units.append(QString::fromLocal8Bit(fields[i+2], static_cast<int>(fieldEnd(i+2) - fields[i+2])).simplified());
+		chunk.units.append(units);
+
+	// Get data
+	} else {
+		for (int i = 0; i <= channels; i++)
+			chunk.columns[i].append(bytes2qreal(fields[i+1], fieldEnd(i+1)));
+	}
+
+	return true;
+}
+
 QStringList ReconTextFile::readCommaSeparatedLine(QString line)
 {
 	QStringList result;
@@ -17,8 +17,20 @@
 #pragma once
 
 #include <QStringList>
+#include <QVarLengthArray>
+#include <QAtomicInteger>
 #include "datafile.h"
 
+// Newline aligned range of the data section and the values parsed from it
+struct ReconTextChunk
+{
+	const char *begin = nullptr;
+	const char *end = nullptr;
+	bool stopped = false;               // Row which does not match the channels found
+	QVector<QVector<double>> columns;   // Time and channels
+	QList<QStringList> units;
+};
+
 class ReconTextFile : public DataFile
 {
 	Q_OBJECT
@@ -26,9 +38,15 @@ public:
 	explicit ReconTextFile(QObject *parent = nullptr);
 	bool importFile(QString filename);
 
+signals:
+	void dataAppended(QVector<double> time, QVector<QVector<double>> data, QStringList names);
+
 #ifndef TESTING
 private:
 #endif
 
 	QStringList readCommaSeparatedLine(QString line);
+	void readDataChunk(ReconTextChunk &chunk, QAtomicInteger<qint64> &progress);
+	void joinDataChunk(const ReconTextChunk &chunk);
+	static bool readDataRow(const char *begin, const char *end, QVarLengthArray<const char*, 64> &fields, ReconTextChunk &chunk);
 };
@@ -0,0 +1,49 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include "samples.h"
+
+// Returns the samples as a vector, the owned one is shared, the mapped one is copied
+QVector<double> Samples::toVector() const
+{
+	if (!isMapped()) return mVector;
+
+	QVector<double> result(mCount);
+	std::copy(mData, mData + mCount, result.begin());
+	return result;
+}
+
+// Returns the vector to modify, the mapped samples are copied first
+QVector<double> &Samples::vector()
+{
+	if (isMapped()) {
+		mVector = toVector();
+		mSource.clear();
+		mData = nullptr;
+		mCount = 0;
+	}
+
+	return mVector;
+}
+
+void Samples::clear()
+{
+	mVector.clear();
+	mSource.clear();
+	mData = nullptr;
+	mCount = 0;
+}
@@ -0,0 +1,52 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <QVector>
+#include "plotfile.h"
+
+// Array of samples, either owned or pointing into the memory mapped plot file.
+// Mapped samples are read only, they are copied on the first modification.
+class Samples
+{
+public:
+	Samples() {}
+	Samples(const QVector<double> &vector) : mVector(vector) {}
+	Samples(PlotFileReaderPtr source, const double *data, qsizetype count)
+		: mSource(source), mData(data), mCount(count) {}
+
+	const double *constData() const {return isMapped() ? mData : mVector.constData();}
+	qsizetype count()         const {return isMapped() ? mCount : mVector.count();}
+	bool isEmpty()            const {return count() == 0;}
+	bool isMapped()           const {return !mSource.isNull();}
+	auto source()             const {return mSource;}
+	double at(qsizetype i)    const {return constData()[i];}
+	double first()            const {return at(0);}
+	double last()             const {return at(count() - 1);}
+	const double *begin()     const {return constData();}
+	const double *end()       const {return constData() + count();}
+
+	QVector<double> toVector() const;
+	QVector<double> &vector();
+	void clear();
+
+private:
+	QVector<double> mVector;
+	PlotFileReaderPtr mSource;
+	const double *mData = nullptr;
+	qsizetype mCount = 0;
+};
@@ -23,6 +23,9 @@ void SettingsDialog::load()
 
 	ui->optionOnlyOne->setChecked(settings.value("OnlyOne", true).toBool());
 	ui->optionRestore->setChecked(settings.value("Restore", true).toBool());
+	ui->optionCompress->setChecked(settings.value("Compress", true).toBool());
+	ui->optionPyramids->setChecked(settings.value("Pyramids", true).toBool());
+	ui->optionBackgroundRendering->setChecked(settings.value("BackgroundRendering", false).toBool());
 }
 
 void SettingsDialog::save()
@@ -31,4 +34,7 @@ void SettingsDialog::save()
 
 	settings.setValue("OnlyOne", ui->optionOnlyOne->isChecked());
 	settings.setValue("Restore", ui->optionRestore->isChecked());
+	settings.setValue("Compress", ui->optionCompress->isChecked());
+	settings.setValue("Pyramids", ui->optionPyramids->isChecked());
+	settings.setValue("BackgroundRendering", ui->optionBackgroundRendering->isChecked());
 }
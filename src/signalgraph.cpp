@@ -0,0 +1,551 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <QDebug>
+#include <QPainter>
+#include <QtConcurrent>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include "signalgraph.h"
+
+namespace {
+
+// Whether the value is taken into account in the sign domain
+bool inSignDomain(double value, QCP::SignDomain domain)
+{
+	if (qIsNaN(value)) return false;
+	switch (domain) {
+	case QCP::sdNegative: return value < 0;
+	case QCP::sdPositive: return value > 0;
+	default:              return true;
+	}
+}
+
+// Index of the first sample not before the key, or the sample just before it for the expanded range
+int beginIndex(const TimeAxis &time, int count, double key, bool expandedRange)
+{
+	int index = static_cast<int>(qMin<qsizetype>(time.indexOf(key), count));
+	if (expandedRange && (index > 0)) index--;
+	return index;
+}
+
+// Index after the last sample not after the key, or after the sample just after it for the expanded range
+int endIndex(const TimeAxis &time, int count, double key, bool expandedRange)
+{
+	if (count == 0) return 0;
+	int index = static_cast<int>(qMin<qsizetype>(time.indexOf(std::nextafter(key, qInf())), count));
+	if (expandedRange && (index < count)) index++;
+	return index;
+}
+
+// Linear axis of the frame rendered in the background. Coordinates are mapped
+// to pixels the same way as QCPAxis does, but without access to the plot.
+struct AxisMapping
+{
+	QCPRange range;
+	double offset;      // Left or bottom pixel of the axis rect
+	double length;      // Width or height of the axis rect
+	bool vertical;
+	bool reversed;
+
+	AxisMapping(const QCPRange &range, const QRect &rect, bool vertical, bool reversed)
+		: range(range)
+		, offset(vertical ? rect.bottom() : rect.left())
+		, length(vertical ? rect.height() : rect.width())
+		, vertical(vertical)
+		, reversed(reversed) {}
+
+	double coordToPixel(double value) const {
+		const double ratio = (reversed ? range.upper - value : value - range.lower) / range.size();
+		return vertical ? offset - ratio * length : offset + ratio * length;
+	}
+
+	double pixelToCoord(double pixel) const {
+		const double ratio = (vertical ? offset - pixel : pixel - offset) / length;
+		return reversed ? range.upper - ratio * range.size() : range.lower + ratio * range.size();
+	}
+
+	int pixelOrientation() const {return (reversed != vertical) ? -1 : 1;}
+	QCPAxis::ScaleType scaleType() const {return QCPAxis::stLinear;}
+};
+
+// Same output as QCPGraph::getOptimizedLineData() for the samples from begin to end,
+// but the cost of the adaptive sampling depends on the count of pixels only.
+// The key axis is either QCPAxis or AxisMapping of the frame rendered in the background.
+template <typename Axis>
+void optimizedSignalData(QVector<QCPGraphData> *lineData, const Axis &keyAxis, const TimeAxis &time, const Samples &values,
+						 const Pyramid *pyramid, double factor, int count, bool adaptiveSampling, int begin, int end)
+{
+	if (begin == end) return;
+
+	auto key = [&time](int i) {return time.at(i);};
+	auto value = [&values, factor](int i) {return values.at(i) * factor;};
+
+	const int dataCount = end - begin;
+	int maxCount = (std::numeric_limits<int>::max)();
+	if (adaptiveSampling) {
+		const double keyPixelSpan = qAbs(keyAxis.coordToPixel(key(begin)) - keyAxis.coordToPixel(key(end - 1)));
+		if (2 * keyPixelSpan + 2 < static_cast<double>((std::numeric_limits<int>::max)())) {
+			maxCount = int(2 * keyPixelSpan + 2);
+		}
+	}
+
+	// Transfer points one-to-one if there are less than two points per pixel on average
+	if (!adaptiveSampling || (dataCount < maxCount)) {
+		lineData->resize(dataCount);
+		for (int i = begin; i < end; i++) (*lineData)[i - begin] = QCPGraphData(key(i), value(i));
+		return;
+	}
+
+	// Limits of the scaled samples are found with the pyramid of the signal
+	auto limits = [&](int first, int last, double &minValue, double &maxValue) {
+		minValue = maxValue = value(first);
+
+		// QCPGraph doesn't expand the span of the cluster started by NaN
+		if (qIsNaN(minValue)) return;
+
+		double lower, upper;
+		if (pyramid != nullptr) {
+			pyramid->limits(values.constData(), first, last, lower, upper);
+			minValue = (factor > 0) ? lower * factor : upper * factor;
+			maxValue = (factor > 0) ? upper * factor : lower * factor;
+		} else {
+			for (int i = first + 1; i < last; i++) {
+				const double current = value(i);
+				if (current < minValue) {
+					minValue = current;
+				} else if (current > maxValue) {
+					maxValue = current;
+				}
+			}
+		}
+	};
+
+	const int reversedFactor = keyAxis.pixelOrientation();     // Calculates keyEpsilon pixel into the correct direction
+	const int reversedRound = reversedFactor == -1 ? 1 : 0;    // Switches between floor and ceil rounding of currentIntervalStartKey
+	double currentIntervalStartKey = keyAxis.pixelToCoord(int(keyAxis.coordToPixel(key(begin)) + reversedRound));
+	double lastIntervalEndKey = currentIntervalStartKey;
+	double keyEpsilon = qAbs(currentIntervalStartKey - keyAxis.pixelToCoord(keyAxis.coordToPixel(currentIntervalStartKey) + 1.0 * reversedFactor));
+	const bool keyEpsilonVariable = keyAxis.scaleType() == QCPAxis::stLogarithmic;
+
+	// Every pixel interval is handled at once instead of sample by sample as QCPGraph does,
+	// the interval ends at the first sample not within the same pixel
+	for (int first = begin; first < end;) {
+		const int last = qBound(first + 1, beginIndex(time, count, currentIntervalStartKey + keyEpsilon, false), end);
+
+		if (last - first >= 2) {
+			// Pixel with multiple data points is consolidated to a cluster
+			double minValue, maxValue;
+			limits(first, last, minValue, maxValue);
+
+			if (lastIntervalEndKey < currentIntervalStartKey - keyEpsilon) {
+				lineData->append(QCPGraphData(currentIntervalStartKey + keyEpsilon * 0.2, value(first)));
+			}
+			lineData->append(QCPGraphData(currentIntervalStartKey + keyEpsilon * 0.25, minValue));
+			lineData->append(QCPGraphData(currentIntervalStartKey + keyEpsilon * 0.75, maxValue));
+			if ((last < end) && (key(last) > currentIntervalStartKey + keyEpsilon * 2)) {
+				lineData->append(QCPGraphData(currentIntervalStartKey + keyEpsilon * 0.8, value(last - 1)));
+			}
+		} else {
+			lineData->append(QCPGraphData(key(first), value(first)));
+		}
+
+		if (last < end) {
+			lastIntervalEndKey = key(last - 1);
+			currentIntervalStartKey = keyAxis.pixelToCoord(int(keyAxis.coordToPixel(key(last)) + reversedRound));
+			if (keyEpsilonVariable) {
+				keyEpsilon = qAbs(currentIntervalStartKey - keyAxis.pixelToCoord(keyAxis.coordToPixel(currentIntervalStartKey) + 1.0 * reversedFactor));
+			}
+		}
+		first = last;
+	}
+}
+
+}
+
+SignalGraph::SignalGraph(QCPAxis *keyAxis, QCPAxis *valueAxis)
+	: QCPGraph(keyAxis, valueAxis), mTime(nullptr), mSignal(nullptr), mBackgroundRendering(false)
+{
+	// Finished image replaces the previous one with the next replot
+	connect(&mRenderWatcher, &QFutureWatcher<Frame>::finished, this, [this]() {
+		mFrame = mRenderWatcher.result();
+		if (mParentPlot) mParentPlot->replot(QCustomPlot::rpQueuedReplot);
+	});
+}
+
+void SignalGraph::setData(const TimeAxis *time, AnalogSignal *signal)
+{
+	mTime = time;
+	mSignal = signal;
+	mFrame = Frame();
+}
+
+void SignalGraph::setBackgroundRendering(bool enabled)
+{
+	mBackgroundRendering = enabled;
+	if (!enabled) mFrame = Frame();
+}
+
+// Signal may be longer than the time axis and vice versa
+int SignalGraph::dataCount() const
+{
+	if ((mTime == nullptr) || (mSignal == nullptr)) return 0;
+	return static_cast<int>(qMin(mTime->count(), mSignal->dataCount()));
+}
+
+double SignalGraph::dataMainKey(int index) const
+{
+	return mTime->at(index);
+}
+
+double SignalGraph::dataSortKey(int index) const
+{
+	return mTime->at(index);
+}
+
+double SignalGraph::dataMainValue(int index) const
+{
+	return mSignal->smoothed().at(index) * multiplier();
+}
+
+QCPRange SignalGraph::dataValueRange(int index) const
+{
+	const double value = dataMainValue(index);
+	return QCPRange(value, value);
+}
+
+QPointF SignalGraph::dataPixelPosition(int index) const
+{
+	if ((index >= 0) && (index < dataCount())) return coordsToPixels(dataMainKey(index), dataMainValue(index));
+
+	qDebug() << Q_FUNC_INFO << "Index out of bounds" << index;
+	return QPointF();
+}
+
+int SignalGraph::findBegin(double sortKey, bool expandedRange) const
+{
+	if (mTime == nullptr) return 0;
+	return beginIndex(*mTime, dataCount(), sortKey, expandedRange);
+}
+
+int SignalGraph::findEnd(double sortKey, bool expandedRange) const
+{
+	if (mTime == nullptr) return 0;
+	return endIndex(*mTime, dataCount(), sortKey, expandedRange);
+}
+
+double SignalGraph::selectTest(const QPointF &pos, bool onlySelectable, QVariant *details) const
+{
+	if ((onlySelectable && (mSelectable == QCP::stNone)) || (dataCount() == 0)) return -1;
+	if (!mKeyAxis || !mValueAxis) return -1;
+
+	if (mKeyAxis.data()->axisRect()->rect().contains(pos.toPoint()) || mParentPlot->interactions().testFlag(QCP::iSelectPlottablesBeyondAxisRect)) {
+		int closestData = dataCount();
+		double result = signalPointDistance(pos, closestData);
+		if (details) details->setValue(QCPDataSelection(QCPDataRange(closestData, closestData + 1)));
+		return result;
+	}
+
+	return -1;
+}
+
+QCPRange SignalGraph::getKeyRange(bool &foundRange, QCP::SignDomain inSignDomain) const
+{
+	QCPRange range;
+	bool haveLower = false;
+	bool haveUpper = false;
+
+	const int count = dataCount();
+	if (count > 0) {
+		const Samples &values = mSignal->smoothed();
+
+		// Keys are sorted, so the range is found from both ends of the data
+		for (int i = 0; i < count; i++) {
+			if (!qIsNaN(values.at(i)) && ::inSignDomain(mTime->at(i), inSignDomain)) {
+				range.lower = mTime->at(i);
+				haveLower = true;
+				break;
+			}
+		}
+
+		for (int i = count - 1; i >= 0; i--) {
+			if (!qIsNaN(values.at(i)) && ::inSignDomain(mTime->at(i), inSignDomain)) {
+				range.upper = mTime->at(i);
+				haveUpper = true;
+				break;
+			}
+		}
+	}
+
+	foundRange = haveLower && haveUpper;
+	return range;
+}
+
+QCPRange SignalGraph::getValueRange(bool &foundRange, QCP::SignDomain inSignDomain, const QCPRange &inKeyRange) const
+{
+	QCPRange range;
+	bool haveLower = false;
+	bool haveUpper = false;
+
+	int begin = 0;
+	int end = dataCount();
+	if (inKeyRange != QCPRange()) {
+		begin = findBegin(inKeyRange.lower, false);
+		end = findEnd(inKeyRange.upper, false);
+	}
+
+	if (begin < end) {
+		const Samples &values = mSignal->smoothed();
+		const double factor = multiplier();
+
+		for (int i = begin; i < end; i++) {
+			const double value = values.at(i) * factor;
+			if (!::inSignDomain(value, inSignDomain)) continue;
+			if ((value < range.lower) || !haveLower) {
+				range.lower = value;
+				haveLower = true;
+			}
+			if ((value > range.upper) || !haveUpper) {
+				range.upper = value;
+				haveUpper = true;
+			}
+		}
+	}
+
+	foundRange = haveLower && haveUpper;
+	return range;
+}
+
+void SignalGraph::draw(QCPPainter *painter)
+{
+	if (!mKeyAxis || !mValueAxis) { qDebug() << Q_FUNC_INFO << "invalid key or value axis"; return; }
+	if ((mKeyAxis.data()->range().size() <= 0) || (dataCount() == 0)) return;
+	if (mLineStyle == lsNone) return;
+	if (drawFrame(painter)) return;
+
+	QVector<QPointF> lines;
+
+	// Loop over and draw segments of unselected/selected data
+	QList<QCPDataRange> selectedSegments, unselectedSegments, allSegments;
+	getDataSegments(selectedSegments, unselectedSegments);
+	allSegments << unselectedSegments << selectedSegments;
+	for (int i = 0; i < allSegments.size(); ++i) {
+		const bool isSelectedSegment = i >= unselectedSegments.size();
+
+		// Unselected segments extend lines to bordering selected data point
+		const QCPDataRange lineDataRange = isSelectedSegment ? allSegments.at(i) : allSegments.at(i).adjusted(-1, 1);
+		getSignalLines(&lines, lineDataRange);
+
+		if (isSelectedSegment && mSelectionDecorator) {
+			mSelectionDecorator->applyPen(painter);
+		} else {
+			painter->setPen(mPen);
+		}
+		painter->setBrush(Qt::NoBrush);
+		drawLinePlot(painter, lines);
+	}
+
+	if (mSelectionDecorator) mSelectionDecorator->drawDecoration(painter, selection());
+}
+
+// Same as QCPGraph::getLines() for the line style
+void SignalGraph::getSignalLines(QVector<QPointF> *lines, const QCPDataRange &dataRange) const
+{
+	if (!lines) return;
+	lines->clear();
+
+	QCPAxis *keyAxis = mKeyAxis.data();
+	if (!keyAxis) { qDebug() << Q_FUNC_INFO << "invalid key axis"; return; }
+
+	// Visible data limited to the data range
+	const int begin = qMax(findBegin(keyAxis->range().lower), qMax(dataRange.begin(), 0));
+	const int end = qMin(findEnd(keyAxis->range().upper), qMin(dataRange.end(), dataCount()));
+	if (begin >= end) return;
+
+	QVector<QCPGraphData> lineData;
+	getOptimizedSignalData(&lineData, begin, end);
+
+	// Make sure key pixels are sorted ascending in lineData
+	if (keyAxis->rangeReversed() != (keyAxis->orientation() == Qt::Vertical)) {
+		std::reverse(lineData.begin(), lineData.end());
+	}
+
+	*lines = dataToLines(lineData);
+}
+
+// Same output as QCPGraph::getOptimizedLineData() for the samples from begin to end
+void SignalGraph::getOptimizedSignalData(QVector<QCPGraphData> *lineData, int begin, int end) const
+{
+	if (!lineData) return;
+	QCPAxis *keyAxis = mKeyAxis.data();
+	if (!keyAxis || !mValueAxis) { qDebug() << Q_FUNC_INFO << "invalid key or value axis"; return; }
+
+	const double factor = multiplier();
+	const Pyramid *pyramid = (qIsFinite(factor) && (factor != 0.0)) ? &mSignal->pyramid() : nullptr;
+	optimizedSignalData(lineData, *keyAxis, *mTime, mSignal->smoothed(), pyramid, factor, dataCount(), mAdaptiveSampling, begin, end);
+}
+
+bool SignalGraph::Frame::isSameView(const Frame &other) const
+{
+	return (keyRange == other.keyRange) && (valueRange == other.valueRange) && (rect == other.rect) && (ratio == other.ratio)
+		&& (keyVertical == other.keyVertical) && (keyReversed == other.keyReversed) && (valueReversed == other.valueReversed)
+		&& (pen == other.pen) && (antialiased == other.antialiased) && (adaptiveSampling == other.adaptiveSampling)
+		&& (factor == other.factor) && (count == other.count) && (smooth == other.smooth) && (revision == other.revision);
+}
+
+// Draws the image rendered in the background, returns false if the graph is to be drawn directly
+bool SignalGraph::drawFrame(QCPPainter *painter)
+{
+	if (!mBackgroundRendering || !selection().isEmpty()) return false;
+
+	// Prints and exports are drawn directly
+	const int deviceType = painter->device()->devType();
+	if ((deviceType != QInternal::Pixmap) && (deviceType != QInternal::Image) && (deviceType != QInternal::Widget)) return false;
+
+	QCPAxis *keyAxis = mKeyAxis.data();
+	QCPAxis *valueAxis = mValueAxis.data();
+	if ((keyAxis->scaleType() != QCPAxis::stLinear) || (valueAxis->scaleType() != QCPAxis::stLinear)) return false;
+	if (keyAxis->orientation() == valueAxis->orientation()) return false;
+
+	Frame view;
+	view.keyRange = keyAxis->range();
+	view.valueRange = valueAxis->range();
+	view.rect = keyAxis->axisRect()->rect();
+	view.ratio = painter->device()->devicePixelRatioF();
+	view.keyVertical = keyAxis->orientation() == Qt::Vertical;
+	view.keyReversed = keyAxis->rangeReversed();
+	view.valueReversed = valueAxis->rangeReversed();
+	view.pen = mPen;
+	view.antialiased = mAntialiased;
+	view.adaptiveSampling = mAdaptiveSampling;
+	view.factor = multiplier();
+	view.usePyramid = qIsFinite(view.factor) && (view.factor != 0.0);
+	view.count = dataCount();
+	view.smooth = mSignal->smooth();
+	view.revision = mSignal->revision();
+	if (view.rect.isEmpty()) return false;
+
+	// The worker gets shared copies of the samples, so they may be changed meanwhile
+	if (!mFrame.isSameView(view) && !mRenderWatcher.isRunning()) {
+		const TimeAxis time = *mTime;
+		const Samples values = mSignal->smoothed();
+		const Pyramid pyramid = view.usePyramid ? mSignal->pyramid() : Pyramid();
+		mRenderWatcher.setFuture(QtConcurrent::run([view, time, values, pyramid]() {
+			return renderFrame(view, time, values, pyramid);
+		}));
+	}
+
+	// Nothing to show until the first image is ready
+	if (mFrame.image.isNull()) return false;
+	if ((mFrame.keyVertical != view.keyVertical) || (mFrame.keyReversed != view.keyReversed) || (mFrame.valueReversed != view.valueReversed)) return false;
+
+	// Corners of the image are moved to their coordinates at the current ranges
+	const AxisMapping keyMapping(mFrame.keyRange, mFrame.rect, mFrame.keyVertical, mFrame.keyReversed);
+	const AxisMapping valueMapping(mFrame.valueRange, mFrame.rect, !mFrame.keyVertical, mFrame.valueReversed);
+	auto corner = [&](const QPointF &pixel) {
+		const double key = mFrame.keyVertical ? keyMapping.pixelToCoord(pixel.y()) : keyMapping.pixelToCoord(pixel.x());
+		const double value = mFrame.keyVertical ? valueMapping.pixelToCoord(pixel.x()) : valueMapping.pixelToCoord(pixel.y());
+		return coordsToPixels(key, value);
+	};
+
+	const QRectF target(corner(QPointF(mFrame.rect.topLeft())), corner(QPointF(mFrame.rect.left() + mFrame.rect.width(), mFrame.rect.top() + mFrame.rect.height())));
+	painter->drawImage(target, mFrame.image);
+	return true;
+}
+
+// Runs on the worker thread, so only the copies of the data are used
+SignalGraph::Frame SignalGraph::renderFrame(Frame frame, const TimeAxis &time, const Samples &values, const Pyramid &pyramid)
+{
+	const AxisMapping keyAxis(frame.keyRange, frame.rect, frame.keyVertical, frame.keyReversed);
+	const AxisMapping valueAxis(frame.valueRange, frame.rect, !frame.keyVertical, frame.valueReversed);
+
+	frame.image = QImage(frame.rect.size() * frame.ratio, QImage::Format_ARGB32_Premultiplied);
+	frame.image.setDevicePixelRatio(frame.ratio);
+	frame.image.fill(Qt::transparent);
+
+	const int begin = beginIndex(time, frame.count, frame.keyRange.lower, true);
+	const int end = endIndex(time, frame.count, frame.keyRange.upper, true);
+	if (begin >= end) return frame;
+
+	QVector<QCPGraphData> lineData;
+	optimizedSignalData(&lineData, keyAxis, time, values, frame.usePyramid ? &pyramid : nullptr, frame.factor, frame.count, frame.adaptiveSampling, begin, end);
+
+	QVector<QPointF> lines;
+	lines.reserve(lineData.count());
+	for (const auto &data : qAsConst(lineData)) {
+		const double key = keyAxis.coordToPixel(data.key) - (frame.keyVertical ? frame.rect.top() : frame.rect.left());
+		const double value = valueAxis.coordToPixel(data.value) - (frame.keyVertical ? frame.rect.left() : frame.rect.top());
+		lines.append(frame.keyVertical ? QPointF(value, key) : QPointF(key, value));
+	}
+
+	QPainter painter(&frame.image);
+	painter.setRenderHint(QPainter::Antialiasing, frame.antialiased);
+
+	// Same as QCPGraph the 1px lines are drawn by the faster cosmetic pen
+	QPen pen = frame.pen;
+	if (qFuzzyCompare(pen.widthF(), 1.0)) pen.setWidth(0);
+	painter.setPen(pen);
+
+	// NaN splits the line
+	for (int first = 0; first < lines.count();) {
+		while ((first < lines.count()) && qIsNaN(lines.at(first).y() + lines.at(first).x())) first++;
+		int last = first;
+		while ((last < lines.count()) && !qIsNaN(lines.at(last).y() + lines.at(last).x())) last++;
+		if (last - first > 1) painter.drawPolyline(lines.constData() + first, last - first);
+		first = last;
+	}
+
+	return frame;
+}
+
+// Same as QCPGraph::pointDistance() for the line style
+double SignalGraph::signalPointDistance(const QPointF &pixelPoint, int &closestData) const
+{
+	closestData = dataCount();
+	if (dataCount() == 0) return -1.0;
+	if (mLineStyle == lsNone) return -1.0;
+
+	// Key range which comes into question, taking selection tolerance around pos into account
+	const QPointF tolerance(mParentPlot->selectionTolerance(), mParentPlot->selectionTolerance());
+	double posKeyMin, posKeyMax, dummy;
+	pixelsToCoords(pixelPoint - tolerance, posKeyMin, dummy);
+	pixelsToCoords(pixelPoint + tolerance, posKeyMax, dummy);
+	if (posKeyMin > posKeyMax) qSwap(posKeyMin, posKeyMax);
+
+	// Choose the data point with the shortest distance to pos
+	double minDistSqr = (std::numeric_limits<double>::max)();
+	const int end = findEnd(posKeyMax, true);
+	for (int i = findBegin(posKeyMin, true); i < end; i++) {
+		const double currentDistSqr = QCPVector2D(coordsToPixels(dataMainKey(i), dataMainValue(i)) - pixelPoint).lengthSquared();
+		if (currentDistSqr < minDistSqr) {
+			minDistSqr = currentDistSqr;
+			closestData = i;
+		}
+	}
+
+	// Line segments may be closer to test point than the data points
+	QVector<QPointF> lines;
+	getSignalLines(&lines, QCPDataRange(0, dataCount()));
+	const QCPVector2D p(pixelPoint);
+	for (int i = 0; i < lines.size() - 1; i++) {
+		const double currentDistSqr = p.distanceSquaredToLine(lines.at(i), lines.at(i + 1));
+		if (currentDistSqr < minDistSqr) minDistSqr = currentDistSqr;
+	}
+
+	return qSqrt(minDistSqr);
+}
@@ -0,0 +1,98 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <QImage>
+#include <QFutureWatcher>
+#include "qcustomplot.h"
+#include "analogsignal.h"
+#include "timeaxis.h"
+
+// Line graph of the analog signal. Keys are read from the time axis of the data
+// file and values from the samples of the signal, so unlike QCPGraph it keeps
+// no copy of the data. The factor and the scale of the signal are applied
+// while the graph is drawn. Only the line style is supported.
+// With the background rendering the line is drawn into an image on a worker
+// thread and the plot only shows the last finished image, stretched to the
+// current ranges of the axes until the image of the current view is ready.
+class SignalGraph : public QCPGraph
+{
+	Q_OBJECT
+
+public:
+	explicit SignalGraph(QCPAxis *keyAxis, QCPAxis *valueAxis);
+
+	AnalogSignal *signal() const {return mSignal;}
+	void setData(const TimeAxis *time, AnalogSignal *signal);
+	bool backgroundRendering() const {return mBackgroundRendering;}
+	void setBackgroundRendering(bool enabled);
+
+	int dataCount() const override;
+	double dataMainKey(int index) const override;
+	double dataSortKey(int index) const override;
+	double dataMainValue(int index) const override;
+	QCPRange dataValueRange(int index) const override;
+	QPointF dataPixelPosition(int index) const override;
+	int findBegin(double sortKey, bool expandedRange = true) const override;
+	int findEnd(double sortKey, bool expandedRange = true) const override;
+
+	double selectTest(const QPointF &pos, bool onlySelectable, QVariant *details = nullptr) const override;
+	QCPRange getKeyRange(bool &foundRange, QCP::SignDomain inSignDomain = QCP::sdBoth) const override;
+	QCPRange getValueRange(bool &foundRange, QCP::SignDomain inSignDomain = QCP::sdBoth, const QCPRange &inKeyRange = QCPRange()) const override;
+
+protected:
+	void draw(QCPPainter *painter) override;
+
+#ifndef TESTING
+private:
+#endif
+	// Image of the graph and the view it is rendered for
+	struct Frame {
+		QCPRange keyRange;
+		QCPRange valueRange;
+		QRect rect;                 // Axis rect in the pixels of the plot
+		qreal ratio = 1.0;          // Device pixel ratio of the image
+		bool keyVertical = false;
+		bool keyReversed = false;
+		bool valueReversed = false;
+		QPen pen;
+		bool antialiased = false;
+		bool adaptiveSampling = true;
+		bool usePyramid = false;
+		double factor = 0.0;
+		int count = 0;
+		quint64 smooth = 0;
+		quint64 revision = 0;
+		QImage image;
+
+		bool isSameView(const Frame &other) const;
+	};
+
+	const TimeAxis *mTime;
+	AnalogSignal *mSignal;
+	bool mBackgroundRendering;
+	Frame mFrame;               // The last finished image
+	QFutureWatcher<Frame> mRenderWatcher;
+
+	double multiplier() const {return mSignal->factor() * mSignal->scale();}
+	bool drawFrame(QCPPainter *painter);
+	static Frame renderFrame(Frame frame, const TimeAxis &time, const Samples &values, const Pyramid &pyramid);
+	void getSignalLines(QVector<QPointF> *lines, const QCPDataRange &dataRange) const;
+	void getOptimizedSignalData(QVector<QCPGraphData> *lineData, int begin, int end) const;
+	double signalPointDistance(const QPointF &pixelPoint, int &closestData) const;
+};
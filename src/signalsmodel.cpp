@@ -137,23 +137,22 @@ QVariant SignalsModel::data(const QModelIndex &index, int role) const
 bool SignalsModel::setData(const QModelIndex &index, const QVariant &value, int role)
 {
 	if ((data(index, role) != value) && (mDataFile != nullptr)) {
-		auto signal = mDataFile->analogSignal(index.row());
 		if ((role == Qt::DisplayRole) || (role == Qt::EditRole)) {
 			switch (static_cast<SignalsModelColumn>(index.column())) {
 			case SignalsModelColumn::Name:
-				signal->setName(value.toString());
+				mDataFile->setName(index.row(), value.toString());
 				break;
 			case SignalsModelColumn::Unit:
-				signal->setUnit(value.toString());
+				mDataFile->setUnit(index.row(), value.toString());
 				break;
 			case SignalsModelColumn::Factor:
-				signal->setFactor(value.toDouble());
+				mDataFile->setFactor(index.row(), value.toDouble());
 				break;
 			case SignalsModelColumn::Scale:
-				signal->setScale(value.toDouble());
+				mDataFile->setScale(index.row(), value.toDouble());
 				break;
 			case SignalsModelColumn::Smooth:
-				signal->setSmooth(value.toDouble());
+				mDataFile->setSmooth(index.row(), value.toDouble());
 				break;
 			case SignalsModelColumn::Color:
 				mDataFile->setColor(index.row(), QColor(value.toString()));
@@ -0,0 +1,68 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include "timeaxis.h"
+
+// Returns the index of the first sample not earlier than the time,
+// or the count of samples if all of them are earlier
+qsizetype TimeAxis::indexOf(double time) const
+{
+	if (!isUniform()) return std::lower_bound(mSamples.begin(), mSamples.end(), time) - mSamples.begin();
+
+	// Estimate the index and correct the rounding of samples
+	const double estimate = std::ceil((time - mEncoding.start) / mEncoding.step);
+	qsizetype index = static_cast<qsizetype>(qBound(0.0, estimate, static_cast<double>(mCount)));
+	while ((index > 0) && (at(index - 1) >= time)) index--;
+	while ((index < mCount) && (at(index) < time)) index++;
+	return index;
+}
+
+// Returns the samples as a vector, the uniform axis is calculated
+QVector<double> TimeAxis::toVector() const
+{
+	if (!isUniform()) return mSamples.toVector();
+
+	QVector<double> result(mCount);
+	for (qsizetype i = 0; i < mCount; i++) result[i] = at(i);
+	return result;
+}
+
+// Drops the samples if the uniform axis gives exactly the same ones
+void TimeAxis::chooseEncoding()
+{
+	if (isUniform()) return;
+
+	mEncoding = ::chooseEncoding(mSamples.constData(), mSamples.count());
+	if (isUniform()) {
+		mCount = mSamples.count();
+		mSamples.clear();
+	}
+}
+
+// Makes the axis independent from the file it is mapped from
+void TimeAxis::detach()
+{
+	if (!isUniform()) mSamples.vector();
+}
+
+void TimeAxis::clear()
+{
+	mSamples.clear();
+	mEncoding = SampleEncoding();
+	mCount = 0;
+}
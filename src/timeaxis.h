@@ -0,0 +1,54 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <QVector>
+#include "plotfile.h"
+#include "samples.h"
+
+// Time axis of the data file. The uniformly sampled axis is described by
+// its uniform encoding and the count of samples, so the time of any sample
+// and the sample at any time are found in O(1) without storing them.
+// The not uniform axis keeps its samples and their compact encoding.
+class TimeAxis
+{
+public:
+	TimeAxis() {}
+	TimeAxis(const Samples &samples) : mSamples(samples) {}
+	TimeAxis(const SampleEncoding &uniform, qsizetype count) : mEncoding(uniform), mCount(count) {}
+
+	bool isUniform()          const {return mEncoding.type == PlotEncoding::Uniform;}
+	auto encoding()           const {return mEncoding;}
+	qsizetype count()         const {return isUniform() ? mCount : mSamples.count();}
+	bool isEmpty()            const {return count() == 0;}
+	double at(qsizetype i)    const {return isUniform() ? mEncoding.uniformValue(static_cast<quint64>(i)) : mSamples.at(i);}
+	double first()            const {return at(0);}
+	double last()             const {return at(count() - 1);}
+	const Samples &samples()  const {return mSamples;}
+	Samples &samples()              {return mSamples;}
+
+	qsizetype indexOf(double time) const;
+	QVector<double> toVector() const;
+	void chooseEncoding();
+	void detach();
+	void clear();
+
+private:
+	Samples mSamples;           // Explicit samples of the not uniform axis
+	SampleEncoding mEncoding;
+	qsizetype mCount = 0;
+};
@@ -16,6 +16,7 @@
 
 
 #include <cmath>
+#include <cctype>
 #include <array>
 #include <QDebug>
 #include <QDir>
@@ -24,6 +25,7 @@
 #include <QSettings>
 #include <QRegularExpression>
 #include "utils.h"
+#include "kernels.h"
 
 double prettyFloor(double value, int places) {
 	if (qIsNull(value) || !qIsFinite(value)) return value;
@@ -54,6 +56,96 @@ qreal str2qreal(const QString str, qreal byDefault) {
 	return byDefault;
 }
 
+// Locale independent conversion of the ASCII number in the range [begin, end).
+// Plain decimal numbers which fit into 53 bits of mantissa and 10^±22 are
+// converted exactly (one correctly rounded IEEE operation), everything else
+// falls back to QByteArray::toDouble(), so the result always matches str2qreal().
+qreal bytes2qreal(const char *begin, const char *end, qreal byDefault) {
+	static const double powers[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	// Trim whitespaces
+	while ((begin < end) && isspace(static_cast<unsigned char>(*begin))) begin++;
+	while ((begin < end) && isspace(static_cast<unsigned char>(*(end - 1)))) end--;
+	if (begin == end) return byDefault;
+
+	const char *p = begin;
+	bool negative = false;
+	if ((*p == '-') || (*p == '+')) negative = (*p++ == '-');
+
+	quint64 mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool fast = true;
+
+	// Integer part
+	const char *integerBegin = p;
+	for (; (p < end) && isdigit(static_cast<unsigned char>(*p)); p++) {
+		if ((mantissa == 0) && (*p == '0')) continue;
+		if (digits < 19) {
+			mantissa = mantissa * 10 + static_cast<quint64>(*p - '0');
+			digits++;
+		} else {
+			fast = false;
+		}
+	}
+	if (p == integerBegin) fast = false;
+
+	// Fractional part
+	if ((p < end) && (*p == '.')) {
+		const char *fractionBegin = ++p;
+		for (; (p < end) && isdigit(static_cast<unsigned char>(*p)); p++) {
+			if ((mantissa == 0) && (*p == '0')) {
+				exponent--;
+				continue;
+			}
+			if (digits < 19) {
+				mantissa = mantissa * 10 + static_cast<quint64>(*p - '0');
+				digits++;
+				exponent--;
+			} else {
+				fast = false;
+			}
+		}
+		if (p == fractionBegin) fast = false;
+	}
+
+	// Exponent
+	if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+		p++;
+		bool negativeExponent = false;
+		if ((p < end) && ((*p == '-') || (*p == '+'))) negativeExponent = (*p++ == '-');
+		const char *exponentBegin = p;
+		int value = 0;
+		for (; (p < end) && isdigit(static_cast<unsigned char>(*p)); p++) {
+			if (value < 10000) value = value * 10 + (*p - '0');
+		}
+		if (p == exponentBegin) fast = false;
+		exponent += negativeExponent ? -value : value;
+	}
+
+	if (fast && (p == end) && (mantissa <= (Q_UINT64_C(1) << 53))) {
+		double result = static_cast<double>(mantissa);
+		if (mantissa == 0) {
+			return negative ? -0.0 : 0.0;
+		} else if ((exponent >= 0) && (exponent <= 22)) {
+			result *= powers[exponent];
+			return negative ? -result : result;
+		} else if ((exponent < 0) && (exponent >= -22)) {
+			result /= powers[-exponent];
+			return negative ? -result : result;
+		}
+	}
+
+	// Slow path: special values, long mantissa, huge exponent or malformed input
+	bool ok;
+	qreal result = QByteArray(begin, static_cast<int>(end - begin)).toDouble(&ok);
+	if (ok) return result;
+	return byDefault;
+}
+
 int str2int(const QString str, int byDefault) {
 	bool ok;
 	int result = str.toInt(&ok);
@@ -89,10 +181,7 @@ void addToRecent(QString filename)
 
 void multyply(QVector<double> &data, const double multiplier)
 {
-	//TODO: add multythread
-	if (multiplier != 1.0) for (qsizetype i = 0; i < data.count(); i++) {
-		data[i] = data.at(i) * multiplier;
-	}
+	if (multiplier != 1.0) Kernels::scale(data.data(), data.count(), multiplier);
 }
 
 QString str2key(QString value)
@@ -28,6 +28,7 @@ double prettyCeil(double value, int places = 2);
 
 bool str2bool(const QString str, bool byDefault = false);
 qreal str2qreal(const QString str, qreal byDefault = 0.0);
+qreal bytes2qreal(const char *begin, const char *end, qreal byDefault = 0.0);
 int str2int(const QString str, int byDefault = 0);
 unsigned int str2uint(const QString str, unsigned int byDefault = 0);
 
@@ -0,0 +1,263 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QtTest>
+#include <QDebug>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QBuffer>
+#include <QThreadPool>
+#include <QRandomGenerator>
+#include <QElapsedTimer>
+#include "../src/utils.h"
+#include "../src/kernels.h"
+#include "../src/recontextfile.h"
+
+// The size of the generated file may be set by the RECON_BENCH_ROWS environment variable,
+// e.g. RECON_BENCH_ROWS=4000000 gives about 500 MB file.
+
+class testBenchmark : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit testBenchmark(QObject *parent = nullptr) : QObject(parent) { ; }
+
+private:
+	static const int channels = 16;
+
+	QTemporaryDir mDir;
+	QString mFileName;
+	QVector<double> mTime;
+	QVector<QVector<double>> mData;
+
+	// The line by line QString based parser used before the memory mapped one
+	void readLegacy(QString filename, QVector<double> &time, QVector<QVector<double>> &data)
+	{
+		QFile datafile(filename);
+		QVERIFY(datafile.open(QIODevice::ReadOnly));
+
+		time.clear();
+		data = QVector<QVector<double>>(channels);
+
+		while (!QString::fromLocal8Bit(datafile.readLine()).simplified().isEmpty());
+		while (!QString::fromLocal8Bit(datafile.readLine()).simplified().isEmpty());
+		datafile.readLine();
+		datafile.readLine();
+
+		for (;;) {
+			QString line = QString::fromLocal8Bit(datafile.readLine()).simplified();
+			QStringList values = line.split(',');
+			if (values.count() != (channels + 3)) break;
+			if (values[0].simplified().isEmpty()) continue;
+
+			time.append(str2qreal(values[1].simplified()));
+			for (int i = 0; i < channels; i++)
+				data[i].append(str2qreal(values[i+2].simplified()));
+		}
+	}
+
+private slots:
+	void initTestCase()
+	{
+		QVERIFY(mDir.isValid());
+		mFileName = mDir.filePath("benchmark.txt");
+
+		int rows = qEnvironmentVariableIntValue("RECON_BENCH_ROWS");
+		if (rows <= 0) rows = 100000;
+
+		QFile datafile(mFileName);
+		QVERIFY(datafile.open(QIODevice::WriteOnly));
+
+		QByteArray block;
+		block += "Benchmark, N403, 490.WINREC, \"Time, s\", \"Voltage, V\", 0, 130, -700, 700\r\n\r\n";
+		for (int i = 0; i < channels; i++)
+			block += QString("   %1, AK-%2, Channel %2, True, 1.0, 1, #7c7c7c\r\n").arg(i + 3).arg(i + 1).toLatin1();
+		block += "\r\n         1,              2,\r\n         N,              t,\r\n";
+
+		block += "          ,              s,";
+		for (int i = 0; i < channels; i++) block += "         V,";
+		block += "\r\n";
+
+		QRandomGenerator generator(12345);
+		for (int row = 0; row < rows; row++) {
+			block += QByteArray::number(row).rightJustified(10, ' ') + ",";
+			block += QByteArray::number(row * 0.0005, 'f', 6).rightJustified(15, ' ') + ",";
+			for (int i = 0; i < channels; i++) {
+				double value = (static_cast<int>(generator.bounded(20000)) - 10000) * 0.001;
+				block += QByteArray::number(value, 'f', 3).rightJustified(10, ' ') + ",";
+			}
+			block += "\r\n";
+
+			if (block.size() > (1 << 20)) {
+				datafile.write(block);
+				block.clear();
+			}
+		}
+
+		datafile.write(block);
+		datafile.close();
+
+		qDebug() << "Generated" << rows << "rows," << QFileInfo(mFileName).size() / (1 << 20) << "MB";
+		readLegacy(mFileName, mTime, mData);
+		QCOMPARE(int(mTime.count()), rows);
+	}
+
+	void test_identical()
+	{
+		ReconTextFile file;
+		QVERIFY(file.importFile(mFileName));
+		QCOMPARE(int(file.analogSignalsCount()), int(channels));
+		QCOMPARE(file.time().toVector(), mTime);
+		for (int i = 0; i < channels; i++) {
+			QCOMPARE(file.analogSignal(i)->unit(), QString("V"));
+			QCOMPARE(file.analogSignal(i)->samples().toVector(), mData[i]);
+		}
+	}
+
+	void benchmark_legacy()
+	{
+		QVector<double> time;
+		QVector<QVector<double>> data;
+		QBENCHMARK_ONCE {
+			readLegacy(mFileName, time, data);
+		}
+	}
+
+	void benchmark_import_data()
+	{
+		QTest::addColumn<int>("threads");
+		QTest::newRow("1 thread")  << 1;
+		QTest::newRow("2 threads") << 2;
+		QTest::newRow("4 threads") << 4;
+		QTest::newRow("8 threads") << 8;
+	}
+
+	void benchmark_import()
+	{
+		QFETCH(int, threads);
+		const int maxThreadCount = QThreadPool::globalInstance()->maxThreadCount();
+		QThreadPool::globalInstance()->setMaxThreadCount(threads);
+
+		ReconTextFile file;
+		QBENCHMARK_ONCE {
+			QVERIFY(file.importFile(mFileName));
+		}
+
+		QThreadPool::globalInstance()->setMaxThreadCount(maxThreadCount);
+	}
+
+	void benchmark_blocks_data()
+	{
+		QTest::addColumn<bool>("encoded");
+		QTest::newRow("zlib doubles") << false;
+		QTest::newRow("zlib encoded") << true;
+	}
+
+	// Writes and reads the time axis and all channels
+	void benchmark_blocks()
+	{
+		QFETCH(bool, encoded);
+
+		QVector<const QVector<double>*> columns = {&mTime};
+		for (const auto &data : qAsConst(mData)) columns.append(&data);
+
+		QBuffer buffer;
+		QVERIFY(buffer.open(QIODevice::ReadWrite));
+		QVector<PlotBlockList> blocks(columns.count());
+
+		QBENCHMARK_ONCE {
+			for (int i = 0; i < columns.count(); i++) {
+				const auto &data = *columns.at(i);
+				const auto encoding = encoded ? chooseEncoding(data.constData(), data.count()) : SampleEncoding();
+				QVERIFY(writeBlocks(buffer, data.constData(), data.count(), blocks[i], PlotCodec::Zlib, encoding));
+			}
+
+			for (int i = 0; i < columns.count(); i++) {
+				QVector<double> data;
+				QVERIFY(readBlocks(buffer, blocks.at(i), data));
+				QCOMPARE(data.count(), columns.at(i)->count());
+			}
+		}
+
+		qDebug() << "Stored" << buffer.size() / 1024 << "KB";
+	}
+
+	void benchmark_kernels_data()
+	{
+		QTest::addColumn<QString>("kernel");
+		QTest::addColumn<int>("set");
+
+		for (const auto &kernel : {"scale", "negate", "limits", "average", "moments"}) {
+			for (auto set : {Kernels::InstructionSet::Scalar, Kernels::InstructionSet::Sse2, Kernels::InstructionSet::Avx}) {
+				QTest::newRow(qPrintable(QString("%1 %2").arg(kernel, Kernels::instructionSetName(set))))
+					<< QString(kernel) << static_cast<int>(set);
+			}
+		}
+	}
+
+	// Throughput of the kernels for the samples of all channels
+	void benchmark_kernels()
+	{
+		QFETCH(QString, kernel);
+		QFETCH(int, set);
+
+		if (!Kernels::setInstructionSet(static_cast<Kernels::InstructionSet>(set))) {
+			QSKIP("The instruction set is not supported");
+		}
+
+		QVector<double> data;
+		for (const auto &channel : qAsConst(mData)) data.append(channel);
+		QVector<double> sums(data.count() + 1);
+		QVector<double> result(data.count());
+		Kernels::prefixSums(data.constData(), data.count(), sums.data());
+
+		auto run = [&]() {
+			double min, max, sum, squares;
+			if (kernel == "scale") {
+				Kernels::scale(data.data(), data.count(), -1.0);
+			} else if (kernel == "negate") {
+				Kernels::negate(data.data(), data.count());
+			} else if (kernel == "limits") {
+				Kernels::limits(data.constData(), data.count(), min, max);
+			} else if (kernel == "average") {
+				Kernels::movingAverage(sums.constData(), data.count(), 16, result.data());
+			} else {
+				Kernels::moments(data.constData(), data.count(), sum, squares);
+			}
+		};
+
+		QBENCHMARK {
+			run();
+		}
+
+		// Bytes of the samples processed per nanosecond are GB/s
+		QElapsedTimer timer;
+		qint64 bytes = 0;
+		timer.start();
+		do {
+			run();
+			bytes += data.count() * static_cast<qint64>(sizeof(double));
+		} while (timer.elapsed() < 200);
+		qDebug() << qPrintable(QString("%1 GB/s").arg(static_cast<double>(bytes) / timer.nsecsElapsed(), 0, 'f', 2));
+
+		Kernels::setInstructionSet(Kernels::supportedInstructionSet());
+	}
+};
+
+QTEST_APPLESS_MAIN(testBenchmark)
+
+#include "tst_benchmark.moc"
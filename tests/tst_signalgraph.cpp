@@ -0,0 +1,89 @@
+//    Recon Plotter
+//    Copyright (C) 2021  Oleksandr Kolodkin <alexandr.kolodkin@gmail.com>
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QtTest>
+#include <QDebug>
+#include "../src/signalgraph.h"
+
+// QCPGraph with the access to the optimized line data
+class LineGraph : public QCPGraph
+{
+public:
+	explicit LineGraph(QCPAxis *keyAxis, QCPAxis *valueAxis) : QCPGraph(keyAxis, valueAxis) { ; }
+	using QCPGraph::getOptimizedLineData;
+};
+
+class testSignalGraph : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit testSignalGraph(QObject *parent = nullptr) : QObject(parent) { ; }
+
+private slots:
+	void test_optimized_data()
+	{
+		// NaN gaps inside the pyramid blocks, at their edges and the single ones
+		QVector<double> keys, values;
+		for (int i = 0; i < 20000; i++) {
+			keys.append(i * 0.001);
+			values.append(std::sin(i * 0.01) * 100.0 + ((i * 7919) % 101));
+		}
+		for (int i = 5000; i < 5100; i++) values[i] = qQNaN();
+		for (int i = 8192; i < 8224; i++) values[i] = qQNaN();
+		values[7777] = qQNaN();
+		values[12001] = qQNaN();
+
+		const TimeAxis time = TimeAxis(Samples(keys));
+		AnalogSignal signal;
+		*signal.mutableData() = values;
+		signal.setScale(2.0);
+
+		QCustomPlot plot;
+		auto *graph = new LineGraph(plot.xAxis, plot.yAxis);
+		auto *signalGraph = new SignalGraph(plot.xAxis, plot.yAxis);
+		signalGraph->setData(&time, &signal);
+
+		QVector<double> scaled = values;
+		for (auto &value : scaled) value *= 2.0;
+		graph->setData(keys, scaled, true);
+
+		// Ranges with the partial blocks at both edges, the whole data and a few samples
+		const QVector<QCPRange> ranges = {{-1.0, 100.0}, {1.2345, 17.8765}, {4.9871, 5.2139}, {7.7705, 7.7851}};
+		for (const int width : {37, 200, 640, 1921, 4000}) {
+			plot.setViewport(QRect(0, 0, width, 300));
+
+			for (const auto &range : ranges) {
+				plot.xAxis->setRange(range);
+				plot.replot();
+
+				QVector<QCPGraphData> lineData, signalData;
+				graph->getOptimizedLineData(&lineData, graph->data()->findBegin(range.lower), graph->data()->findEnd(range.upper));
+				signalGraph->getOptimizedSignalData(&signalData, signalGraph->findBegin(range.lower), signalGraph->findEnd(range.upper));
+
+				QCOMPARE(signalData.count(), lineData.count());
+				for (int i = 0; i < lineData.count(); i++) {
+					QVERIFY(signalData.at(i).key == lineData.at(i).key);
+					QVERIFY((signalData.at(i).value == lineData.at(i).value) || (qIsNaN(signalData.at(i).value) && qIsNaN(lineData.at(i).value)));
+				}
+			}
+		}
+	}
+};
+
+QTEST_MAIN(testSignalGraph)
+
+#include "tst_signalgraph.moc"
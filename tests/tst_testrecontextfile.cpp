@@ -18,6 +18,9 @@
 #include <QDebug>
 #include <QString>
 #include <QStringList>
+#include <QTemporaryDir>
+#include <QBuffer>
+#include <cmath>
 #include "../src/recontextfile.h"
 
 // add necessary includes here
@@ -69,11 +72,481 @@ private slots:
 
 	void test_read_data()
 	{
-		QVERIFY(mReconTextFile.analogSignal(0)->data()->count() == 10);
-		QVERIFY(mReconTextFile.analogSignal(0)->data()->at(0) == -2.314);
+		QVERIFY(mReconTextFile.analogSignal(0)->samples().count() == 10);
+		QVERIFY(mReconTextFile.analogSignal(0)->samples().at(0) == -2.314);
 		QVERIFY(mReconTextFile.analogSignal(0)->minY() == -2.314);
 		QVERIFY(mReconTextFile.analogSignal(0)->maxY() == 2.314);
 	}
+
+	void test_save_open()
+	{
+		QTemporaryDir dir;
+		QString filename = dir.filePath("test_data.plot");
+		QVERIFY(mReconTextFile.saveAs(filename));
+
+		DataFile datafile;
+		QVERIFY(datafile.open(filename));
+		QCOMPARE(datafile.title(), mReconTextFile.title());
+		QCOMPARE(datafile.time().toVector(), mReconTextFile.time().toVector());
+		QVERIFY(datafile.analogSignalsCount() == mReconTextFile.analogSignalsCount());
+
+		for (int i = 0; i < datafile.analogSignalsCount(); i++) {
+			QVERIFY(!datafile.analogSignal(i)->isLoaded());
+			QVERIFY(datafile.analogSignal(i)->dataCount() == mReconTextFile.analogSignal(i)->dataCount());
+			QCOMPARE(datafile.analogSignal(i)->minY(), mReconTextFile.analogSignal(i)->minY());
+			QCOMPARE(datafile.analogSignal(i)->mean(), mReconTextFile.analogSignal(i)->mean());
+			QCOMPARE(datafile.analogSignal(i)->rms(), mReconTextFile.analogSignal(i)->rms());
+			QVERIFY(!datafile.analogSignal(i)->isLoaded());
+			QCOMPARE(datafile.analogSignal(i)->name(), mReconTextFile.analogSignal(i)->name());
+			QCOMPARE(datafile.analogSignal(i)->unit(), mReconTextFile.analogSignal(i)->unit());
+			QVERIFY(datafile.analogSignal(i)->smooth() == mReconTextFile.analogSignal(i)->smooth());
+			QCOMPARE(datafile.analogSignal(i)->samples().toVector(), mReconTextFile.analogSignal(i)->samples().toVector());
+			QVERIFY(datafile.analogSignal(i)->isLoaded());
+		}
+	}
+
+	void test_encoding()
+	{
+		// Three decimals in the export
+		const auto encoding = mReconTextFile.analogSignal(0)->encoding();
+		QVERIFY(encoding.type == PlotEncoding::Int16);
+		QCOMPARE(encoding.divisor, 1000.0);
+
+		const QVector<double> shorts = {-2.314, 0.0, 1.543, 2.314};
+		const QVector<double> ints = {-100000.5, 0.5, 100000.5};
+		const QVector<double> floats = {0.1f, -3.25f, 1e20f};
+		const QVector<double> doubles = {0.1, 1.0 / 3.0};
+		const QVector<double> smooth = {0.001, 0.002, 0.003, 0.002, 0.001, 0.0, -0.001, -0.002, 0.1};
+		QVERIFY(chooseEncoding(shorts.constData(), shorts.count()).type == PlotEncoding::Int16);
+		QVERIFY(chooseEncoding(ints.constData(), ints.count()).type == PlotEncoding::Int32);
+		QVERIFY(chooseEncoding(smooth.constData(), smooth.count()).type == PlotEncoding::DeltaInt16);
+		QVERIFY(chooseEncoding(floats.constData(), floats.count()).type == PlotEncoding::XorFloat32);
+		QVERIFY(chooseEncoding(doubles.constData(), doubles.count()).type == PlotEncoding::XorDouble);
+
+		// The negative zero is kept
+		const QVector<double> zeros = {0.5, -0.0, 0.0, -0.5};
+		QVERIFY(chooseEncoding(zeros.constData(), zeros.count()).type == PlotEncoding::XorFloat32);
+		QVERIFY(chooseEncoding(zeros.constData() + 1, 1).type == PlotEncoding::XorFloat32);
+
+		// Samples which don't fit the encoding are stored as doubles
+		QBuffer buffer;
+		QVERIFY(buffer.open(QIODevice::ReadWrite));
+		for (const auto &data : {shorts, ints, floats, doubles, zeros}) {
+			PlotBlockList blocks;
+			QVector<double> restored;
+			QVERIFY(writeBlocks(buffer, data.constData(), data.count(), blocks, PlotCodec::Raw, encoding));
+			QVERIFY(readBlocks(buffer, blocks, restored));
+			QCOMPARE(restored, data);
+			for (qsizetype i = 0; i < data.count(); i++) QVERIFY(std::signbit(restored.at(i)) == std::signbit(data.at(i)));
+			QVERIFY(blocks.first().encoding == ((data == shorts) ? PlotEncoding::Int16 : PlotEncoding::Double));
+		}
+
+		// Inverted samples are saved in the encoding which fits them
+		AnalogSignal ramp;
+		*ramp.mutableData() = {0.5, 1.5, 2.5, 3.5};
+		ramp.chooseEncoding();
+		QVERIFY(ramp.encoding().type == PlotEncoding::Uniform);
+		ramp.invert();
+		PlotBlockList blocks;
+		QVector<double> restored;
+		QVERIFY(writeBlocks(buffer, ramp.samples().constData(), ramp.samples().count(), blocks, PlotCodec::Zlib, ramp.encoding()));
+		QVERIFY(readBlocks(buffer, blocks, restored));
+		QCOMPARE(restored, QVector<double>({-0.5, -1.5, -2.5, -3.5}));
+
+		QTemporaryDir dir;
+		QString filename = dir.filePath("test_data_inverted.plot");
+		const auto inverted = [this]() {
+			auto data = mReconTextFile.analogSignal(0)->samples().toVector();
+			for (auto &value : data) value = -value;
+			return data;
+		}();
+		mReconTextFile.analogSignal(0)->invert();
+		const bool saved = mReconTextFile.saveAs(filename);
+		mReconTextFile.analogSignal(0)->invert();
+		QVERIFY(saved);
+
+		DataFile datafile;
+		QVERIFY(datafile.open(filename));
+		QCOMPARE(datafile.analogSignal(0)->samples().toVector(), inverted);
+	}
+
+	void test_time_axis()
+	{
+		// Time axis is exported with six decimals
+		const QVector<double> time = {0.0, 0.0005, 0.001001, 0.001501, 0.002002, 0.002502, 0.003002, 0.003503, 0.004003, 0.004504};
+		QVERIFY(mReconTextFile.time().isUniform());
+		QCOMPARE(mReconTextFile.time().toVector(), time);
+
+		const TimeAxis samples = TimeAxis(Samples(time));
+		TimeAxis uniform = TimeAxis(Samples(time));
+		uniform.chooseEncoding();
+		QVERIFY(!samples.isUniform());
+		QVERIFY(uniform.isUniform());
+		QVERIFY(uniform.samples().isEmpty());
+
+		for (const auto &axis : {samples, uniform}) {
+			QVERIFY(axis.count() == time.count());
+			QCOMPARE(axis.at(3), 0.001501);
+			QVERIFY(axis.indexOf(-1.0) == 0);
+			QVERIFY(axis.indexOf(0.0) == 0);
+			QVERIFY(axis.indexOf(0.001501) == 3);
+			QVERIFY(axis.indexOf(0.0015011) == 4);
+			QVERIFY(axis.indexOf(0.004504) == 9);
+			QVERIFY(axis.indexOf(1.0) == 10);
+		}
+	}
+
+	void test_smooth()
+	{
+		AnalogSignal signal;
+		*signal.mutableData() = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0};
+		QCOMPARE(signal.smoothed().toVector(), signal.samples().toVector());
+
+		signal.setSmooth(3);
+		QCOMPARE(signal.smoothed().toVector(), QVector<double>({1.0, 1.5, 2.0, 3.0, 4.0, 5.0}));
+
+		// The width of the window may exceed the count of samples
+		signal.setSmooth(10);
+		QCOMPARE(signal.smoothed().toVector(), QVector<double>({1.0, 1.5, 2.0, 2.5, 3.0, 3.5}));
+
+		// Scale doesn't change the smoothed samples
+		signal.setScale(2.0);
+		signal.setSmooth(2);
+		QCOMPARE(signal.smoothed().toVector(), QVector<double>({1.0, 1.5, 2.5, 3.5, 4.5, 5.5}));
+	}
+
+	void test_statistics()
+	{
+		AnalogSignal signal;
+		QVERIFY(qIsNaN(signal.mean()));
+
+		*signal.mutableData() = {1.0, -2.0, qQNaN(), 3.0};
+		signal.calculateLimits();
+		QCOMPARE(signal.minY(), -2.0);
+		QCOMPARE(signal.maxY(), 3.0);
+		QVERIFY(qIsNaN(signal.mean()));
+
+		*signal.mutableData() = {1.0, -2.0, 3.0, 6.0};
+		signal.setFactor(2.0);
+		signal.calculateLimits();
+		QCOMPARE(signal.minY(), -4.0);
+		QCOMPARE(signal.maxY(), 12.0);
+		QCOMPARE(signal.mean(), 4.0);
+		QCOMPARE(signal.rms(), 2.0 * qSqrt(12.5));
+
+		signal.invert();
+		QCOMPARE(signal.minY(), -12.0);
+		QCOMPARE(signal.maxY(), 4.0);
+		QCOMPARE(signal.mean(), -4.0);
+	}
+
+	void test_pyramid()
+	{
+		// Three levels with NaN samples and a partial block at the end
+		QVector<double> data;
+		for (qsizetype i = 0; i < 40000; i++) data.append(((i * 7919) % 1000) - 500.0);
+		for (qsizetype i = 1000; i < 1100; i++) data[i] = qQNaN();
+		data[20000] = -1000.0;
+		data[39999] = 1000.0;
+
+		Pyramid pyramid;
+		pyramid.build(data.constData(), data.count());
+		QVERIFY(pyramid.count() == data.count());
+
+		const QVector<QPair<qsizetype, qsizetype>> ranges = {{0, 40000}, {5, 6}, {31, 33}, {1000, 1100}, {999, 1101}, {19000, 20001}, {20001, 39999}, {7, 39000}};
+		for (const auto &range : ranges) {
+			double min, max, expectedMin = qInf(), expectedMax = -qInf();
+			for (qsizetype i = range.first; i < range.second; i++) {
+				if (qIsNaN(data.at(i))) continue;
+				expectedMin = qMin(expectedMin, data.at(i));
+				expectedMax = qMax(expectedMax, data.at(i));
+			}
+
+			const bool found = pyramid.limits(data.constData(), range.first, range.second, min, max);
+			QCOMPARE(found, expectedMin <= expectedMax);
+			if (found) {
+				QCOMPARE(min, expectedMin);
+				QCOMPARE(max, expectedMax);
+			}
+		}
+	}
+
+	void test_pyramid_stored()
+	{
+		QTemporaryDir dir;
+		QString filename = dir.filePath("test_data_pyramid.plot");
+		QVERIFY(mReconTextFile.saveAs(filename));
+
+		// Levels of the compressed file are read without loading the samples
+		DataFile datafile;
+		QVERIFY(datafile.open(filename));
+		for (int i = 0; i < datafile.analogSignalsCount(); i++) {
+			auto *signal = datafile.analogSignal(i);
+			const auto &pyramid = signal->pyramid();
+			QVERIFY(!signal->isLoaded());
+			QCOMPARE(pyramid.count(), signal->dataCount());
+
+			Pyramid built;
+			const auto &samples = mReconTextFile.analogSignal(i)->samples();
+			built.build(samples.constData(), samples.count());
+			QCOMPARE(pyramid.minimums().toVector(), built.minimums().toVector());
+			QCOMPARE(pyramid.maximums().toVector(), built.maximums().toVector());
+		}
+	}
+
+	void test_save_open_uncompressed()
+	{
+		QTemporaryDir dir;
+		QString filename = dir.filePath("test_data_raw.plot");
+		mReconTextFile.setCompressed(false);
+		QVERIFY(mReconTextFile.saveAs(filename));
+		mReconTextFile.setCompressed(true);
+
+		DataFile datafile;
+		QVERIFY(datafile.open(filename));
+		QCOMPARE(datafile.time().toVector(), mReconTextFile.time().toVector());
+
+		for (int i = 0; i < datafile.analogSignalsCount(); i++) {
+			auto &samples = datafile.analogSignal(i)->samples();
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+			QVERIFY(samples.isMapped());
+#endif
+			QCOMPARE(samples.toVector(), mReconTextFile.analogSignal(i)->samples().toVector());
+
+			// Stored pyramid matches the samples
+			const auto &pyramid = datafile.analogSignal(i)->pyramid();
+			QVERIFY(pyramid.count() == samples.count());
+			QVERIFY(pyramid.minimums().count() == Pyramid::levels(samples.count()).last());
+		}
+
+		// Copy on write
+		datafile.analogSignal(0)->invert();
+		QVERIFY(!datafile.analogSignal(0)->samples().isMapped());
+		QCOMPARE(datafile.analogSignal(0)->samples().at(0), -mReconTextFile.analogSignal(0)->samples().at(0));
+	}
+
+	void test_save_progress()
+	{
+		QTemporaryDir dir;
+		QString filename = dir.filePath("test_data_progress.plot");
+
+		QSignalSpy range(&mReconTextFile, &DataFile::updateProgressRange);
+		QSignalSpy value(&mReconTextFile, &DataFile::updateProgressValue);
+		QVERIFY(mReconTextFile.saveAs(filename));
+		QVERIFY(range.count() == 1);
+		QVERIFY(value.count() > 1);
+		QCOMPARE(value.last().at(0).toInt(), range.first().at(1).toInt());
+
+		// Cancelled after the first block
+		auto connection = connect(&mReconTextFile, &DataFile::updateProgressValue, &mReconTextFile, &DataFile::cansel);
+		QVERIFY(!mReconTextFile.saveAs(dir.filePath("test_data_cancelled.plot")));
+		disconnect(connection);
+		QVERIFY(mReconTextFile.saveAs(filename));
+	}
+
+	void test_save_metadata()
+	{
+		QTemporaryDir dir;
+		QString filename = dir.filePath("test_data_metadata.plot");
+		QVERIFY(mReconTextFile.saveAs(filename));
+
+		DataFile datafile;
+		QVERIFY(datafile.open(filename));
+		const auto size = QFileInfo(filename).size();
+
+		// Directory is appended, the samples are not written again
+		datafile.analogSignal(0)->setName("Renamed");
+		datafile.analogSignal(0)->setScale(2.0);
+		QVERIFY(datafile.canSaveMetadataOnly(filename));
+		QVERIFY(datafile.save());
+		QVERIFY(QFileInfo(filename).size() > size);
+
+		DataFile reopened;
+		QVERIFY(reopened.open(filename));
+		QCOMPARE(reopened.analogSignal(0)->name(), QString("Renamed"));
+		QCOMPARE(reopened.analogSignal(0)->scale(), 2.0);
+		for (int i = 0; i < reopened.analogSignalsCount(); i++) {
+			QCOMPARE(reopened.analogSignal(i)->samples().toVector(), mReconTextFile.analogSignal(i)->samples().toVector());
+			QVERIFY(reopened.analogSignal(i)->pyramid().count() == reopened.analogSignal(i)->dataCount());
+		}
+
+		// Changed samples are saved entirely
+		reopened.analogSignal(1)->invert();
+		QVERIFY(!reopened.canSaveMetadataOnly(filename));
+		QVERIFY(reopened.save());
+
+		DataFile inverted;
+		QVERIFY(inverted.open(filename));
+		QCOMPARE(inverted.analogSignal(1)->samples().at(0), -mReconTextFile.analogSignal(1)->samples().at(0));
+		QCOMPARE(inverted.analogSignal(0)->name(), QString("Renamed"));
+
+		// Directories not used any more are dropped before they take much of the file
+		const auto saved = QFileInfo(filename).size();
+		bool dropped = false;
+		for (int i = 0; i < 20; i++) {
+			inverted.analogSignal(0)->setName(QString("Renamed %1").arg(i));
+			dropped = dropped || !inverted.canSaveMetadataOnly(filename);
+			QVERIFY(inverted.save());
+			QVERIFY(QFileInfo(filename).size() < 2 * saved);
+
+			DataFile repeated;
+			QVERIFY(repeated.open(filename));
+			QCOMPARE(repeated.analogSignal(0)->name(), QString("Renamed %1").arg(i));
+			QCOMPARE(repeated.analogSignal(1)->samples().at(0), -mReconTextFile.analogSignal(1)->samples().at(0));
+		}
+		QVERIFY(dropped);
+
+		// Directory which was not written entirely is ignored
+		QFile file(filename);
+		QVERIFY(file.open(QIODevice::ReadWrite));
+		QDataStream header(&file);
+		quint32 magic, version;
+		quint64 directory;
+		header >> magic >> version >> directory;
+		QVERIFY(file.seek(static_cast<qint64>(directory)));
+		const QByteArray last = file.readAll();
+		QVERIFY(file.seek(file.size()));
+		QVERIFY(file.write(last.left(last.size() / 2)) == last.size() / 2);
+		file.close();
+
+		DataFile truncated;
+		QVERIFY(truncated.open(filename));
+		QCOMPARE(truncated.analogSignal(0)->name(), QString("Renamed 19"));
+		for (int i = 0; i < truncated.analogSignalsCount(); i++) {
+			QVERIFY(!truncated.analogSignal(i)->isLoaded());
+			QCOMPARE(truncated.analogSignal(i)->mean(), inverted.analogSignal(i)->mean());
+		}
+
+		truncated.analogSignal(0)->setName("Recovered");
+		QVERIFY(truncated.save());
+
+		DataFile recovered;
+		QVERIFY(recovered.open(filename));
+		QCOMPARE(recovered.analogSignal(0)->name(), QString("Recovered"));
+		for (int i = 0; i < recovered.analogSignalsCount(); i++) {
+			QCOMPARE(recovered.analogSignal(i)->samples().toVector(), truncated.analogSignal(i)->samples().toVector());
+		}
+	}
+
+	void test_snapshot()
+	{
+		QTemporaryDir dir;
+		QString filename = dir.filePath("test_data_snapshot.plot");
+
+		// Snapshot isn't changed with the file
+		QScopedPointer<DataFile> snapshot(mReconTextFile.snapshot());
+		mReconTextFile.analogSignal(1)->setName("Renamed");
+		mReconTextFile.analogSignal(1)->invert();
+		QVERIFY(snapshot->saveAs(filename));
+		mReconTextFile.analogSignal(1)->invert();
+		mReconTextFile.analogSignal(1)->setName(snapshot->analogSignal(1)->name());
+
+		DataFile datafile;
+		QVERIFY(datafile.open(filename));
+		QVERIFY(datafile.analogSignalsCount() == mReconTextFile.analogSignalsCount());
+		for (int i = 0; i < datafile.analogSignalsCount(); i++) {
+			QCOMPARE(datafile.analogSignal(i)->name(), mReconTextFile.analogSignal(i)->name());
+			QCOMPARE(datafile.analogSignal(i)->samples().toVector(), mReconTextFile.analogSignal(i)->samples().toVector());
+		}
+	}
+
+	void test_save_over_open()
+	{
+		QTemporaryDir dir;
+		QString filename = dir.filePath("test_data_over.plot");
+		QVERIFY(mReconTextFile.saveAs(filename));
+
+		DataFile datafile;
+		QVERIFY(datafile.open(filename));
+
+		// Snapshot is saved over the file its samples are read from, the signals are not loaded
+		datafile.setCompressed(false);
+		QScopedPointer<DataFile> snapshot(datafile.snapshot());
+		QVERIFY(snapshot->saveAs(filename));
+		for (int i = 0; i < datafile.analogSignalsCount(); i++) QVERIFY(!datafile.analogSignal(i)->isLoaded());
+
+		// Signals are read from the saved file, which is not compressed
+		datafile.setSaved(snapshot.data());
+		QVERIFY(datafile.canSaveMetadataOnly(filename));
+		for (int i = 0; i < datafile.analogSignalsCount(); i++) {
+			QVERIFY(!datafile.analogSignal(i)->isLoaded());
+			const auto &samples = datafile.analogSignal(i)->samples();
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+			QVERIFY(samples.isMapped());
+#endif
+			QCOMPARE(samples.toVector(), mReconTextFile.analogSignal(i)->samples().toVector());
+		}
+
+		// Only the metadata is saved, so the signals keep reading the same file
+		const auto sources = datafile.analogSignal(0)->sources();
+		datafile.analogSignal(0)->setName("Renamed");
+		QScopedPointer<DataFile> renamed(datafile.snapshot());
+		QVERIFY(renamed->saveAs(filename));
+		datafile.setSaved(renamed.data());
+		QVERIFY(datafile.analogSignal(0)->sources() == sources);
+	}
+
+	void test_save_over_mapped()
+	{
+		QTemporaryDir dir;
+		QString filename = dir.filePath("test_data_mapped.plot");
+		QScopedPointer<DataFile> uncompressed(mReconTextFile.snapshot());
+		uncompressed->setCompressed(false);
+		QVERIFY(uncompressed->saveAs(filename));
+
+		DataFile datafile;
+		QVERIFY(datafile.open(filename));
+		for (int i = 0; i < datafile.analogSignalsCount(); i++) datafile.analogSignal(i)->samples();
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+		QVERIFY(datafile.isMapped(filename));
+#endif
+
+		// The whole file is written again over the mapped one
+		datafile.setCompressed(true);
+		QVERIFY(!datafile.canSaveMetadataOnly(filename));
+		QVERIFY(datafile.save());
+		QVERIFY(!datafile.isMapped(filename));
+		for (int i = 0; i < datafile.analogSignalsCount(); i++) {
+			QCOMPARE(datafile.analogSignal(i)->samples().toVector(), mReconTextFile.analogSignal(i)->samples().toVector());
+		}
+
+		DataFile reopened;
+		QVERIFY(reopened.open(filename));
+		QVERIFY(!reopened.isMapped(filename));
+		for (int i = 0; i < reopened.analogSignalsCount(); i++) {
+			QCOMPARE(reopened.analogSignal(i)->samples().toVector(), mReconTextFile.analogSignal(i)->samples().toVector());
+		}
+	}
+
+	void test_open_version1()
+	{
+		QByteArray data;
+		QDataStream datastream(&data, QIODevice::WriteOnly);
+		datastream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+		datastream << static_cast<quint32>(0x504C4F54) << static_cast<quint32>(1);
+		datastream.setVersion(QDataStream::Qt_5_0);
+		datastream << QString("Title") << QString("Device") << QString("Original") << QString("X") << QString("Y");
+		datastream << 0.0 << 1.0 << -1.0 << 1.0 << 0.0 << 1.0 << -1.0 << 1.0;
+		datastream << static_cast<quint64>(2) << 0.0 << 1.0;
+		datastream << static_cast<quint64>(1);
+		datastream << QString("Signal") << QString("V") << true << 1.0 << 2.0 << static_cast<quint64>(1)
+				   << -1.0 << 1.0 << QString("#ff0000") << static_cast<quint64>(2) << -1.0 << 1.0;
+
+		QTemporaryDir dir;
+		QFile file(dir.filePath("version1.plot"));
+		QVERIFY(file.open(QIODevice::WriteOnly));
+		file.write(qCompress(data));
+		file.close();
+
+		DataFile datafile;
+		QVERIFY(datafile.open(file.fileName()));
+		QCOMPARE(datafile.title(), QString("Title"));
+		QCOMPARE(datafile.time().toVector(), QVector<double>({0.0, 1.0}));
+		QVERIFY(datafile.analogSignalsCount() == 1);
+		QCOMPARE(datafile.analogSignal(0)->name(), QString("Signal"));
+		QCOMPARE(datafile.analogSignal(0)->scale(), 2.0);
+		QCOMPARE(datafile.analogSignal(0)->samples().toVector(), QVector<double>({-1.0, 1.0}));
+	}
 };
 
 QTEST_APPLESS_MAIN(testReconTextFile)
@@ -17,6 +17,7 @@
 #include <QtTest>
 #include <QColor>
 #include "../src/utils.h"
+#include "../src/kernels.h"
 
 class testUtils : public QObject
 {
@@ -72,6 +73,25 @@ private slots:
 		QCOMPARE(str2qreal("99.9", 111), 99.9);
 	}
 
+	void test_bytes2qreal()
+	{
+		const QStringList values = {
+			"0", "-0", "999", "-999", "99.9", "  -2.314 ", "0.000500", "1e-5", "-1.5E+3",
+			"123456789012345678901234", "0.1234567890123456789", "1e300", "inf", "-nan", "1.", "abc", ""
+		};
+
+		foreach (auto value, values) {
+			QByteArray bytes = value.toLatin1();
+			qreal expected = str2qreal(value.simplified(), 111.0);
+			qreal actual = bytes2qreal(bytes.constData(), bytes.constData() + bytes.size(), 111.0);
+			if (qIsNaN(expected)) {
+				QVERIFY(qIsNaN(actual));
+			} else {
+				QCOMPARE(memcmp(&actual, &expected, sizeof(qreal)), 0);
+			}
+		}
+	}
+
 	void test_prettyFloor(){
 		QCOMPARE(prettyFloor(qInf()), qInf());
 		QCOMPARE(prettyFloor(-qInf()), -qInf());
@@ -113,6 +133,54 @@ private slots:
 		QCOMPARE(prettyCeil(-qInf()), -qInf());
 		QCOMPARE(prettyCeil(0.000), 0.000);
 	}
+
+	void test_kernels_data()
+	{
+		QTest::addColumn<int>("set");
+		QTest::newRow("Scalar") << static_cast<int>(Kernels::InstructionSet::Scalar);
+		QTest::newRow("SSE2")   << static_cast<int>(Kernels::InstructionSet::Sse2);
+		QTest::newRow("AVX")    << static_cast<int>(Kernels::InstructionSet::Avx);
+	}
+
+	// Odd count of samples leaves tails for the vectorised implementations
+	void test_kernels()
+	{
+		QFETCH(int, set);
+		if (!Kernels::setInstructionSet(static_cast<Kernels::InstructionSet>(set))) {
+			QSKIP("The instruction set is not supported");
+		}
+
+		const QVector<double> data = {1.0, -2.0, qQNaN(), 4.0, 5.0, 6.0, -7.0, 8.0, 9.0};
+
+		QVector<double> scaled = data;
+		Kernels::scale(scaled.data(), scaled.count(), 0.5);
+		QCOMPARE(scaled.at(8), 4.5);
+		QCOMPARE(scaled.at(1), -1.0);
+
+		QVector<double> negated = data;
+		Kernels::negate(negated.data(), negated.count());
+		QCOMPARE(negated.at(0), -1.0);
+		QCOMPARE(negated.at(8), -9.0);
+
+		double min, max;
+		QVERIFY(Kernels::limits(data.constData(), data.count(), min, max));
+		QCOMPARE(min, -7.0);
+		QCOMPARE(max, 9.0);
+		QVERIFY(!Kernels::limits(data.constData() + 2, 1, min, max));
+
+		const QVector<double> ramp = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0};
+		QVector<double> sums(ramp.count() + 1), average(ramp.count());
+		Kernels::prefixSums(ramp.constData(), ramp.count(), sums.data());
+		Kernels::movingAverage(sums.constData(), ramp.count(), 3, average.data());
+		QCOMPARE(average, QVector<double>({1.0, 1.5, 2.0, 3.0, 4.0, 5.0, 6.0}));
+
+		double sum, squares;
+		Kernels::moments(ramp.constData(), ramp.count(), sum, squares);
+		QCOMPARE(sum, 28.0);
+		QCOMPARE(squares, 140.0);
+
+		Kernels::setInstructionSet(Kernels::supportedInstructionSet());
+	}
 };
 
 QTEST_APPLESS_MAIN(testUtils)